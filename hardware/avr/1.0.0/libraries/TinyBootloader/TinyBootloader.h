@@ -0,0 +1,39 @@
+#ifndef __TinyBootloader_h__
+#define __TinyBootloader_h__
+
+#include <avr/wdt.h>
+
+extern "C" {
+  #include <usbdrv.h>
+}
+
+/* Vendor request that makes a running sketch restart into the Micronucleus
+ * bootloader, so micronucleus++ can upload without the board being replugged.
+ * Call TinyBootloader::handleSetup() from usbFunctionSetup() before looking
+ * at any other vendor request.
+ *
+ * The sketch is reset by the watchdog, which leaves time for the status stage
+ * of the request to reach the host. The bootloader stays active after a
+ * watchdog reset until the upload is done or AUTO_EXIT_MS has passed.
+ * Must match MICRONUCLEUS_APP_REQUEST_BOOTLOADER in micronucleus++, which
+ * only sends it to devices with the vendor and device names of TinyKeyboard,
+ * TinyRawHID or TinyUSBStream (MICRONUCLEUS_APP_PRODUCTS).
+ */
+#define USBRQ_ENTER_BOOTLOADER 0xb0
+
+namespace TinyBootloader {
+  inline void enter() {
+    wdt_enable(WDTO_60MS);
+  }
+
+  // returns true if the request was ours
+  inline bool handleSetup(usbRequest_t *rq) {
+    if ((rq->bmRequestType & USBRQ_TYPE_MASK) != USBRQ_TYPE_VENDOR) return false;
+    if (rq->bRequest != USBRQ_ENTER_BOOTLOADER) return false;
+
+    enter();
+    return true;
+  }
+}
+
+#endif // __TinyBootloader_h__
@@ -4,13 +4,16 @@
 #include <Arduino.h>
 #include <Print.h>
 #include <avr/wdt.h>
-#include <util/delay.h>
 
 extern "C" {
   #include <usbdrv.h>
 }
 
+#include <TinyBootloader.h>
+
 #include "ascii_keycode_table.h"
+#include "key_string.h"
+#include "key_script.h"
 
 
 #define LEFT_CONTROL  _BV(0)
@@ -24,20 +27,62 @@ extern "C" {
 
 
 USB_PUBLIC usbMsgLen_t usbFunctionSetup(uchar data[8]);
+USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len);
+
+// bits of the LED output report, see onLedChange()
+#define LED_NUM_LOCK    _BV(0)
+#define LED_CAPS_LOCK   _BV(1)
+#define LED_SCROLL_LOCK _BV(2)
+#define LED_COMPOSE     _BV(3)
+#define LED_KANA        _BV(4)
+
+// consumer control usages for sendConsumerKey(), from the HID Usage Tables
+#define CONSUMER_PLAY_PAUSE   0x00cd
+#define CONSUMER_STOP         0x00b7
+#define CONSUMER_NEXT_TRACK   0x00b5
+#define CONSUMER_PREV_TRACK   0x00b6
+#define CONSUMER_MUTE         0x00e2
+#define CONSUMER_VOLUME_UP    0x00e9
+#define CONSUMER_VOLUME_DOWN  0x00ea
 
-/* We use a simplifed keyboard report descriptor which does not support the
- * boot protocol. We don't allow setting status LEDs and but we do allow
- * simultaneous key presses. 
+// buttons for setMouseButtons()
+#define MOUSE_LEFT    _BV(0)
+#define MOUSE_RIGHT   _BV(1)
+#define MOUSE_MIDDLE  _BV(2)
+
+/* The report has the layout of the boot protocol: a byte of modifiers, a
+ * reserved byte and up to six keys pressed at the same time. The host sets
+ * the keyboard LEDs with a one byte output report, also the boot protocol's.
+ * Since both protocols use the same reports, SET_PROTOCOL only changes what
+ * GET_PROTOCOL answers.
  * The report descriptor has been created with usb.org's "HID Descriptor Tool"
  * which can be downloaded from http://www.usb.org/developers/hidpage/.
  * Redundant entries (such as LOGICAL_MINIMUM and USAGE_PAGE) have been omitted
- * for the second INPUT item.
+ * for the later INPUT items.
+ *
+ * With TINY_KEYBOARD_COMPOSITE (Tools > USB device) the descriptor has three
+ * collections, told apart by the report ID in the first byte of each report:
+ *
+ *   1 keyboard          modifiers, six keys; LEDs out
+ *   2 consumer control  one 16 bit usage, such as CONSUMER_MUTE
+ *   3 mouse             buttons, x, y and wheel, relative
+ *
+ * A low speed endpoint sends at most 8 bytes, so the keyboard report trades
+ * its reserved byte for the ID. In the boot protocol, which hosts pick only
+ * for the keyboard, the keyboard report is sent without an ID in the 8 byte
+ * layout above and media keys and mouse movement are dropped.
  */
 
+#define REPORT_ID_KEYBOARD  1
+#define REPORT_ID_CONSUMER  2
+#define REPORT_ID_MOUSE     3
+
+#if TINY_KEYBOARD_COMPOSITE
 const char usbHidReportDescriptor[USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH] PROGMEM = {
   0x05, 0x01, // USAGE_PAGE (Generic Desktop) 
   0x09, 0x06, // USAGE (Keyboard) 
   0xa1, 0x01, // COLLECTION (Application) 
+  0x85, 0x01, //   REPORT_ID (1) 
   0x05, 0x07, //   USAGE_PAGE (Keyboard) 
   0x19, 0xe0, //   USAGE_MINIMUM (Keyboard LeftControl) 
   0x29, 0xe7, //   USAGE_MAXIMUM (Keyboard Right GUI) 
@@ -46,39 +91,205 @@ const char usbHidReportDescriptor[USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH] PROGMEM
   0x75, 0x01, //   REPORT_SIZE (1) 
   0x95, 0x08, //   REPORT_COUNT (8) 
   0x81, 0x02, //   INPUT (Data,Var,Abs) 
-  0x95, 0x01, //   REPORT_COUNT (simultaneous keystrokes) 
+  0x95, 0x05, //   REPORT_COUNT (5) 
+  0x75, 0x01, //   REPORT_SIZE (1) 
+  0x05, 0x08, //   USAGE_PAGE (LEDs) 
+  0x19, 0x01, //   USAGE_MINIMUM (Num Lock) 
+  0x29, 0x05, //   USAGE_MAXIMUM (Kana) 
+  0x91, 0x02, //   OUTPUT (Data,Var,Abs) 
+  0x95, 0x01, //   REPORT_COUNT (1) 
+  0x75, 0x03, //   REPORT_SIZE (3) 
+  0x91, 0x03, //   OUTPUT (Cnst,Var,Abs) 
+  0x95, 0x06, //   REPORT_COUNT (simultaneous keystrokes) 
   0x75, 0x08, //   REPORT_SIZE (8) 
   0x25, 0x65, //   LOGICAL_MAXIMUM (101) 
+  0x05, 0x07, //   USAGE_PAGE (Keyboard) 
+  0x19, 0x00, //   USAGE_MINIMUM (Reserved (no event indicated)) 
+  0x29, 0x65, //   USAGE_MAXIMUM (Keyboard Application) 
+  0x81, 0x00, //   INPUT (Data,Ary,Abs) 
+  0xc0,       // END_COLLECTION 
+  0x05, 0x0c, // USAGE_PAGE (Consumer Devices) 
+  0x09, 0x01, // USAGE (Consumer Control) 
+  0xa1, 0x01, // COLLECTION (Application) 
+  0x85, 0x02, //   REPORT_ID (2) 
+  0x26, 0xff, 0x03, //   LOGICAL_MAXIMUM (1023) 
+  0x19, 0x00, //   USAGE_MINIMUM (Unassigned) 
+  0x2a, 0xff, 0x03, //   USAGE_MAXIMUM (1023) 
+  0x75, 0x10, //   REPORT_SIZE (16) 
+  0x95, 0x01, //   REPORT_COUNT (1) 
+  0x81, 0x00, //   INPUT (Data,Ary,Abs) 
+  0xc0,       // END_COLLECTION 
+  0x05, 0x01, // USAGE_PAGE (Generic Desktop) 
+  0x09, 0x02, // USAGE (Mouse) 
+  0xa1, 0x01, // COLLECTION (Application) 
+  0x85, 0x03, //   REPORT_ID (3) 
+  0x09, 0x01, //   USAGE (Pointer) 
+  0xa1, 0x00, //   COLLECTION (Physical) 
+  0x05, 0x09, //     USAGE_PAGE (Button) 
+  0x19, 0x01, //     USAGE_MINIMUM (Button 1) 
+  0x29, 0x03, //     USAGE_MAXIMUM (Button 3) 
+  0x25, 0x01, //     LOGICAL_MAXIMUM (1) 
+  0x75, 0x01, //     REPORT_SIZE (1) 
+  0x95, 0x03, //     REPORT_COUNT (3) 
+  0x81, 0x02, //     INPUT (Data,Var,Abs) 
+  0x95, 0x01, //     REPORT_COUNT (1) 
+  0x75, 0x05, //     REPORT_SIZE (5) 
+  0x81, 0x03, //     INPUT (Cnst,Var,Abs) 
+  0x05, 0x01, //     USAGE_PAGE (Generic Desktop) 
+  0x09, 0x30, //     USAGE (X) 
+  0x09, 0x31, //     USAGE (Y) 
+  0x09, 0x38, //     USAGE (Wheel) 
+  0x15, 0x81, //     LOGICAL_MINIMUM (-127) 
+  0x25, 0x7f, //     LOGICAL_MAXIMUM (127) 
+  0x75, 0x08, //     REPORT_SIZE (8) 
+  0x95, 0x03, //     REPORT_COUNT (3) 
+  0x81, 0x06, //     INPUT (Data,Var,Rel) 
+  0xc0,       //   END_COLLECTION 
+  0xc0        // END_COLLECTION 
+};
+#else
+const char usbHidReportDescriptor[USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH] PROGMEM = {
+  0x05, 0x01, // USAGE_PAGE (Generic Desktop) 
+  0x09, 0x06, // USAGE (Keyboard) 
+  0xa1, 0x01, // COLLECTION (Application) 
+  0x05, 0x07, //   USAGE_PAGE (Keyboard) 
+  0x19, 0xe0, //   USAGE_MINIMUM (Keyboard LeftControl) 
+  0x29, 0xe7, //   USAGE_MAXIMUM (Keyboard Right GUI) 
+  0x15, 0x00, //   LOGICAL_MINIMUM (0) 
+  0x25, 0x01, //   LOGICAL_MAXIMUM (1) 
+  0x75, 0x01, //   REPORT_SIZE (1) 
+  0x95, 0x08, //   REPORT_COUNT (8) 
+  0x81, 0x02, //   INPUT (Data,Var,Abs) 
+  0x95, 0x01, //   REPORT_COUNT (1) 
+  0x75, 0x08, //   REPORT_SIZE (8) 
+  0x81, 0x03, //   INPUT (Cnst,Var,Abs) 
+  0x95, 0x05, //   REPORT_COUNT (5) 
+  0x75, 0x01, //   REPORT_SIZE (1) 
+  0x05, 0x08, //   USAGE_PAGE (LEDs) 
+  0x19, 0x01, //   USAGE_MINIMUM (Num Lock) 
+  0x29, 0x05, //   USAGE_MAXIMUM (Kana) 
+  0x91, 0x02, //   OUTPUT (Data,Var,Abs) 
+  0x95, 0x01, //   REPORT_COUNT (1) 
+  0x75, 0x03, //   REPORT_SIZE (3) 
+  0x91, 0x03, //   OUTPUT (Cnst,Var,Abs) 
+  0x95, 0x06, //   REPORT_COUNT (simultaneous keystrokes) 
+  0x75, 0x08, //   REPORT_SIZE (8) 
+  0x25, 0x65, //   LOGICAL_MAXIMUM (101) 
+  0x05, 0x07, //   USAGE_PAGE (Keyboard) 
   0x19, 0x00, //   USAGE_MINIMUM (Reserved (no event indicated)) 
   0x29, 0x65, //   USAGE_MAXIMUM (Keyboard Application) 
   0x81, 0x00, //   INPUT (Data,Ary,Abs) 
   0xc0        // END_COLLECTION 
 };
+#endif
 
-static unsigned char idleRate;
+/* Text and key strokes go into a type-ahead buffer and return at once.
+ * update() (and delay(), which calls it) hands them on to usbdrv's interrupt
+ * queue whenever it has room, so the sketch keeps running while they are
+ * typed at one report per poll interval. Each key stroke takes two bytes of
+ * the buffer, and a character two key strokes, its press and its release.
+ * Only a full buffer makes write() and sendKeyStroke() wait; flush() waits
+ * until everything has been sent.
+ *
+ * Characters waiting in the buffer are packed: a run of up to
+ * TINY_KEYBOARD_KEYS_PER_REPORT characters with the same modifiers and no
+ * key twice goes out as one report pressing all their keys and one
+ * releasing them. Hosts type the keys of a report in the order of its
+ * slots. Dead keys go out on their own. Define it to 1 to send every press
+ * and release on its own.
+ */
+#ifndef TINY_KEYBOARD_BUFFER_SIZE
+#define TINY_KEYBOARD_BUFFER_SIZE 32
+#endif
+
+#ifndef TINY_KEYBOARD_KEYS_PER_REPORT
+#define TINY_KEYBOARD_KEYS_PER_REPORT 6
+#endif
+
+/* With TINY_KEYBOARD_COMPOSITE, media keys wait in a queue of their own, two
+ * usages a key (press and release), and mouse movement adds up until a
+ * report takes it. update() takes turns between the keyboard, the media keys
+ * and the mouse, so each gets every third report while they all have
+ * something to send: a long text doesn't hold up the volume keys.
+ */
+#ifndef TINY_KEYBOARD_CONSUMER_QUEUE
+#define TINY_KEYBOARD_CONSUMER_QUEUE 4
+#endif
+
+#if !USB_CFG_INTR_QUEUE_SIZE || USB_CFG_INTR_QUEUE_REPORT_LEN < 8
+#error "TinyKeyboard needs the interrupt queue: USB_CFG_INTR_QUEUE_SIZE in its usbconfig.h"
+#endif
+
+#if TINY_KEYBOARD_KEYS_PER_REPORT < 1 || TINY_KEYBOARD_KEYS_PER_REPORT > 6
+#error "TINY_KEYBOARD_KEYS_PER_REPORT must be 1 to 6"
+#endif
+
+#if TINY_KEYBOARD_CONSUMER_QUEUE < 2
+#error "TINY_KEYBOARD_CONSUMER_QUEUE must be at least 2"
+#endif
+
+/* The idle rate the host sets, in units of 4 ms: update() sends the current
+ * report again when none has been sent for that long, and never sends the
+ * same report twice in a row otherwise. 0, which Linux and Windows set, sends
+ * a report only when it changes. It starts at the 500 ms the HID
+ * specification recommends for keyboards.
+ */
+static unsigned char idleRate = 500 / 4;
+unsigned char usbKeyboardProtocol = 1;  // 0 boot, 1 report; USB_RESET_HOOK resets it
+#if TINY_KEYBOARD_COMPOSITE
+static unsigned char reportReply[8];    // GET_REPORT's answer, with its report ID
+#endif
 
 class TinyKeyboard : public Print {
 public:
-  TinyKeyboard() {
+  TinyKeyboard() : bufferHead(0), buffered(0), idleSince(0), ledState(0), ledsSeen(0), ledCallback(0),
+                   script(0), scriptRunner(0), usbState(USB_OFF)
+#if TINY_KEYBOARD_COMPOSITE
+    , consumerHead(0), consumerCount(0), consumerSent(0), mouseX(0), mouseY(0), mouseWheel(0),
+      mouseButtons(0), mouseButtonsSent(0), nextSource(0)
+#endif
+  {
+    // a restart by the watchdog leaves it running; USB waits for begin()
     wdt_disable();
-    noInterrupts();
+  }
 
+  // starts USB without waiting: the device lets go of the bus for 250 ms so
+  // that the host enumerates it afresh, and update() connects it again once
+  // they are up, so the pause overlaps the sketch's own setup. update()
+  // calls it if the sketch hasn't; calling it again reconnects. usbInit()
+  // empties usbdrv's queue and the new session starts with no key held
+  // down; what the sketch typed is kept until the host has configured the
+  // device.
+  void begin() {
+    noInterrupts();
     usbInit();
-
     usbDeviceDisconnect();
-    _delay_ms(250);
-    usbDeviceConnect();
-
+    usbConfiguration = 0;
     interrupts();
 
-    // TODO: Remove the next two lines once we fix
-    //       missing first keystroke bug properly.
-    // memset(reportBuffer, 0, sizeof(reportBuffer));      
-    // usbSetInterrupt(reportBuffer, sizeof(reportBuffer));
+    usbSince = millis();
+    usbState = USB_DISCONNECTED;
+    memset(reportBuffer, 0, sizeof(reportBuffer));
+#if TINY_KEYBOARD_COMPOSITE
+    consumerSent = 0;
+    mouseButtonsSent = 0;
+#endif
   }
-  
+
   void update() {
+    if (usbState != USB_CONNECTED) {
+      if (usbState == USB_OFF) begin();
+      if ((uint16_t)((uint16_t)millis() - usbSince) < 250) return;
+      usbDeviceConnect();
+      usbState = USB_CONNECTED;
+    }
     usbPoll();
+    if (ledState != ledsSeen) {
+      ledsSeen = ledState;
+      if (ledCallback) ledCallback(ledState);
+    }
+    if (scriptRunner) (this->*scriptRunner)();
+    sendBuffered();
   }
   
   void delay(unsigned long ms) {
@@ -88,31 +299,394 @@ public:
   
   size_t write(uint8_t ch) {
     if (ch & 0x80) return 0;
-    uint8_t data = pgm_read_byte_near(ascii_to_keycode + ch);
-    sendKeyStroke(data & 0x7F, (data & 0x80) ? RIGHT_SHIFT : 0);
-    sendKeyStroke(0);
+    typeKey(pgm_read_word_near(ascii_to_keycode + ch));
     return 1;
   }
 
+  // types a string translated by KSTR() (see key_string.h)
+  template <unsigned N> void type(const KeyString<N> *keys) {
+    typeKeys(keys->codes);
+  }
+
   void sendKeyStroke(uint8_t keyStroke) {
     sendKeyStroke(keyStroke, 0);
   }
 
+  // buffers the report; waits only while the buffer is full. Key codes are
+  // below 0x80: bit 7 keeps the key out of reports with other keys.
   void sendKeyStroke(uint8_t keyStroke, uint8_t modifiers) {
-    while (!usbInterruptIsReady()) update();
-    
-    reportBuffer[0] = modifiers;
-    reportBuffer[1] = keyStroke;
+    while (buffered == TINY_KEYBOARD_BUFFER_SIZE) update();
+
+    unsigned char *last = entry(buffered++);
+    last[0] = modifiers;
+    last[1] = keyStroke;
+
+    sendBuffered();
+  }
+
+  // starts playing a key script from flash (see key_script.h), in place of
+  // any that is playing. update() types it as the type-ahead buffer has
+  // room, so it goes out at full speed while the sketch runs on; text the
+  // sketch types meanwhile is mixed in. The code to play scripts only takes
+  // flash in sketches that call play().
+  void play(const uint8_t *keyScript) {
+    script = keyScript;
+    scriptState = SCRIPT_RUN;
+    scriptModifiers = 0;
+    scriptRunner = &TinyKeyboard::runScript;
+  }
+
+  bool playing() {
+    return script != 0;
+  }
+
+  // stops the script, letting go of anything it held
+  void stop() {
+    if (!script) return;
+    script = 0;
+    sendKeyStroke(0);
+  }
+
+  // the keyboard LEDs as the host last set them: LED_NUM_LOCK, LED_CAPS_LOCK
+  // and so on. The host sets them on every keyboard at once, so they follow
+  // the lock keys of any keyboard on it.
+  uint8_t leds() {
+    return ledState;
+  }
 
-    usbSetInterrupt(reportBuffer, sizeof(reportBuffer));
+  // calls callback from update() with the new LEDs each time the host
+  // changes them; the callback may type
+  void onLedChange(void (*callback)(uint8_t leds)) {
+    ledCallback = callback;
   }
-    
+
+#if TINY_KEYBOARD_COMPOSITE
+  // clicks a media key: a consumer control usage such as CONSUMER_MUTE is
+  // pressed in one report and released in the next. Waits only while the
+  // queue is full. Ignored in the boot protocol, like the mouse.
+  void sendConsumerKey(uint16_t usage) {
+    if (!usbKeyboardProtocol) return;
+    while (consumerCount > TINY_KEYBOARD_CONSUMER_QUEUE - 2) update();
+
+    consumerPush(usage);
+    consumerPush(0);
+    sendBuffered();
+  }
+
+  // moves the pointer and the wheel; what the reports can't take yet (127 a
+  // report) is kept for the next ones
+  void moveMouse(int8_t x, int8_t y, int8_t wheel = 0) {
+    if (!usbKeyboardProtocol) return;
+    addMovement(mouseX, x);
+    addMovement(mouseY, y);
+    addMovement(mouseWheel, wheel);
+    sendBuffered();
+  }
+
+  // the buttons held down, MOUSE_LEFT and so on. Call update() between a
+  // press and its release, or a report may carry neither.
+  void setMouseButtons(uint8_t buttons) {
+    mouseButtons = buttons;
+    sendBuffered();
+  }
+#endif
+
+  // characters write() takes without waiting
+  int availableForWrite() {
+    return (TINY_KEYBOARD_BUFFER_SIZE - buffered) / 2;
+  }
+
+  // waits until the host has every buffered report
+  void flush() {
+    while (buffered || !usbInterruptQueueIsEmpty() || !usbInterruptIsReady()
+#if TINY_KEYBOARD_COMPOSITE
+           || consumerCount || mousePending()
+#endif
+          ) update();
+  }
+
 private:
-  unsigned char reportBuffer[2];
+  unsigned char reportBuffer[8];
+  unsigned char buffer[TINY_KEYBOARD_BUFFER_SIZE][2];
+  uint8_t bufferHead;
+  uint8_t buffered;
+  uint16_t idleSince;  // millis() when reportBuffer was last queued
+  volatile uint8_t ledState;
+  uint8_t ledsSeen;
+  void (*ledCallback)(uint8_t leds);
+  const uint8_t *script;        // the next instruction, 0 when none plays
+  const uint8_t *scriptLoop;    // the first instruction after KS_REPEAT
+  void (TinyKeyboard::*scriptRunner)();
+  uint16_t scriptDelay;
+  uint16_t scriptSince;         // millis() when the delay started
+  uint8_t scriptRepeats;
+  uint8_t scriptModifiers;
+  uint8_t scriptState;
+  enum { SCRIPT_RUN, SCRIPT_TEXT, SCRIPT_DRAIN, SCRIPT_WAIT };
+  uint16_t usbSince;            // millis() when begin() let go of the bus
+  uint8_t usbState;
+  enum { USB_OFF, USB_DISCONNECTED, USB_CONNECTED };
+#if TINY_KEYBOARD_COMPOSITE
+  uint16_t consumerQueue[TINY_KEYBOARD_CONSUMER_QUEUE];
+  uint8_t consumerHead;
+  uint8_t consumerCount;
+  uint16_t consumerSent;
+  int16_t mouseX, mouseY, mouseWheel;  // movement not sent yet
+  uint8_t mouseButtons;
+  uint8_t mouseButtonsSent;
+  uint8_t nextSource;                  // 0 keyboard, 1 media keys, 2 mouse
+#endif
+
+  // presses and releases a key in ascii_to_keycode's format; a dead key is
+  // pressed on its own and followed by a space. While Caps Lock is on, hosts
+  // swap the case of letters, so a letter is typed with shift toggled; the
+  // LEDs count at the time it is buffered.
+  void typeKey(uint16_t data) {
+    uint8_t modifiers = data >> 8;
+    if (modifiers & (LETTER(0) >> 8)) {
+      modifiers &= ~(LETTER(0) >> 8);
+      if (ledState & LED_CAPS_LOCK) modifiers ^= RIGHT_SHIFT;
+    }
+    sendKeyStroke(data, modifiers);
+    sendKeyStroke(0);
+    if (data & DEAD(0)) {
+      sendKeyStroke(KC_SPACE);
+      sendKeyStroke(0);
+    }
+  }
+
+  void typeKeys(const uint16_t *codes) {
+    uint16_t data;
+    while ((data = pgm_read_word_near(codes++))) typeKey(data);
+  }
+
+  // runs the script while the buffer has room for a character, even one on a
+  // dead key, so that it never waits for update() itself
+  void runScript() {
+    while (script && TINY_KEYBOARD_BUFFER_SIZE - buffered >= 4) {
+      if (scriptState == SCRIPT_DRAIN) {
+        if (buffered || !usbInterruptQueueIsEmpty()) return;
+        scriptSince = millis();
+        scriptState = SCRIPT_WAIT;
+      }
+      if (scriptState == SCRIPT_WAIT) {
+        if ((uint16_t)((uint16_t)millis() - scriptSince) < scriptDelay) return;
+        scriptState = SCRIPT_RUN;
+      }
+
+      uint8_t op = pgm_read_byte_near(script++);
+      if (scriptState == SCRIPT_TEXT) {
+        if (op) write(op);
+        else scriptState = SCRIPT_RUN;
+        continue;
+      }
+      switch (op) {
+      case KS_END:
+        script = 0;
+        break;
+      case KS_TEXT:
+        scriptState = SCRIPT_TEXT;
+        break;
+      case KS_TAP:
+        sendKeyStroke(pgm_read_byte_near(script++), scriptModifiers);
+        sendKeyStroke(0, scriptModifiers);
+        break;
+      case KS_PRESS:
+        sendKeyStroke(pgm_read_byte_near(script++), scriptModifiers);
+        break;
+      case KS_RELEASE:
+        sendKeyStroke(0, scriptModifiers);
+        break;
+      case KS_MODIFIERS:
+        scriptModifiers = pgm_read_byte_near(script++);
+        sendKeyStroke(0, scriptModifiers);
+        break;
+      case KS_DELAY:
+        scriptDelay = pgm_read_word_near(script);
+        script += 2;
+        scriptState = SCRIPT_DRAIN;
+        break;
+      case KS_REPEAT:
+        scriptRepeats = pgm_read_byte_near(script++);
+        scriptLoop = script;
+        break;
+      case KS_NEXT:
+        if (scriptRepeats > 1) {
+          scriptRepeats--;
+          script = scriptLoop;
+        }
+        break;
+      }
+    }
+  }
+
+  // the i-th buffered key stroke
+  unsigned char *entry(uint8_t i) {
+    i += bufferHead;
+    if (i >= TINY_KEYBOARD_BUFFER_SIZE) i -= TINY_KEYBOARD_BUFFER_SIZE;
+    return buffer[i];
+  }
+
+  // fills report from the front of the buffer and returns the number of
+  // key strokes it took: a press followed by a release takes the presses of
+  // the characters after it with it, the last release stays for the next
+  // report
+  uint8_t packReport(unsigned char *report) {
+    unsigned char *first = entry(0);
+    uint8_t keys = 1, used = 1;
+
+    memset(report, 0, sizeof(reportBuffer));
+    report[0] = first[0];
+    report[2] = first[1] & 0x7F;
+    if (!first[1] || (first[1] & 0x80)) return used;
+
+    while (keys < TINY_KEYBOARD_KEYS_PER_REPORT && used + 2 < buffered) {
+      unsigned char *release = entry(used), *press = entry(used + 1), *next = entry(used + 2);
+      if (release[0] || release[1] || next[0] || next[1]) break;
+      if (press[0] != first[0] || !press[1] || (press[1] & 0x80)) break;
+      if (memchr(report + 2, press[1], keys)) break;
+      report[2 + keys++] = press[1];
+      used += 2;
+    }
+    return used;
+  }
+
+  // queues the next keyboard report from the type-ahead buffer unless it
+  // repeats the last one; returns false if the buffer is empty
+  bool sendKeys() {
+    if (!buffered) return false;
+
+    unsigned char report[sizeof(reportBuffer)];
+    uint8_t used = packReport(report);
+    if (memcmp(report, reportBuffer, sizeof(reportBuffer))) {
+      memcpy(reportBuffer, report, sizeof(reportBuffer));
+      queueKeys();
+    }
+    bufferHead += used;
+    if (bufferHead >= TINY_KEYBOARD_BUFFER_SIZE) bufferHead -= TINY_KEYBOARD_BUFFER_SIZE;
+    buffered -= used;
+    return true;
+  }
+
+  // queues reportBuffer in the layout of the protocol the host chose
+  void queueKeys() {
+#if TINY_KEYBOARD_COMPOSITE
+    unsigned char report[8];
+    if (usbKeyboardProtocol) usbQueueInterrupt(report, getReport(REPORT_ID_KEYBOARD, report));
+    else usbQueueInterrupt(reportBuffer, sizeof(reportBuffer));
+#else
+    usbQueueInterrupt(reportBuffer, sizeof(reportBuffer));
+#endif
+    idleSince = millis();
+  }
+
+  // moves reports to usbdrv's queue while it has room; reportBuffer keeps the
+  // last keyboard report for GET_REPORT. Until the host has configured the
+  // device they stay in the buffers, where usbInit() and a bus reset can't
+  // empty them. When the queue is empty, it sends reportBuffer again every
+  // idle period.
+  void sendBuffered() {
+    if (usbState != USB_CONNECTED || !usbConfiguration) return;
+
+#if TINY_KEYBOARD_COMPOSITE
+    for (uint8_t waiting = 0; waiting < 3 && !usbInterruptQueueIsFull();) {
+      bool sent = nextSource == 0 ? sendKeys() : nextSource == 1 ? sendConsumer() : sendMouse();
+      if (++nextSource == 3) nextSource = 0;
+      waiting = sent ? 0 : waiting + 1;
+    }
+#else
+    while (!usbInterruptQueueIsFull() && sendKeys()) {}
+#endif
+    if (idleRate && usbInterruptQueueIsEmpty() &&
+        (uint16_t)((uint16_t)millis() - idleSince) >= idleRate * 4) {
+      queueKeys();
+    }
+  }
+
+#if TINY_KEYBOARD_COMPOSITE
+  void consumerPush(uint16_t usage) {
+    uint8_t i = consumerHead + consumerCount++;
+    if (i >= TINY_KEYBOARD_CONSUMER_QUEUE) i -= TINY_KEYBOARD_CONSUMER_QUEUE;
+    consumerQueue[i] = usage;
+  }
+
+  // queues the next media key report; the boot protocol drops them
+  bool sendConsumer() {
+    if (!consumerCount) return false;
+
+    uint16_t usage = consumerQueue[consumerHead];
+    if (++consumerHead == TINY_KEYBOARD_CONSUMER_QUEUE) consumerHead = 0;
+    consumerCount--;
+    if (!usbKeyboardProtocol || usage == consumerSent) return true;
+
+    unsigned char report[3];
+    consumerSent = usage;
+    usbQueueInterrupt(report, getReport(REPORT_ID_CONSUMER, report));
+    return true;
+  }
+
+  bool mousePending() {
+    return mouseX || mouseY || mouseWheel || mouseButtons != mouseButtonsSent;
+  }
+
+  // queues a mouse report with what it can take of the movement
+  bool sendMouse() {
+    if (!mousePending()) return false;
+    if (!usbKeyboardProtocol) {
+      mouseX = mouseY = mouseWheel = 0;
+      mouseButtonsSent = mouseButtons;
+      return true;
+    }
+
+    unsigned char report[5];
+    mouseButtonsSent = mouseButtons;
+    getReport(REPORT_ID_MOUSE, report);
+    report[2] = takeMovement(mouseX);
+    report[3] = takeMovement(mouseY);
+    report[4] = takeMovement(mouseWheel);
+    usbQueueInterrupt(report, sizeof(report));
+    return true;
+  }
+
+  // adds to movement that is waiting. Past 0x3fff either way, about 130
+  // reports, it stops growing: the delta is cut, never dropped.
+  static void addMovement(int16_t &total, int8_t delta) {
+    int16_t sum = total + delta;
+    total = sum > 0x3fff ? 0x3fff : sum < -0x3fff ? -0x3fff : sum;
+  }
+
+  // up to 127 of the movement, taken from it
+  static int8_t takeMovement(int16_t &total) {
+    int8_t part = total > 127 ? 127 : total < -127 ? -127 : total;
+    total -= part;
+    return part;
+  }
+
+  // writes the last report of a collection in the report protocol, with its
+  // ID, and returns its length; the mouse's has the buttons but no movement
+  uint8_t getReport(uint8_t id, unsigned char *report) {
+    report[0] = id;
+    if (id == REPORT_ID_CONSUMER) {
+      report[1] = consumerSent;
+      report[2] = consumerSent >> 8;
+      return 3;
+    }
+    if (id == REPORT_ID_MOUSE) {
+      report[1] = mouseButtonsSent;
+      report[2] = report[3] = report[4] = 0;
+      return 5;
+    }
+    report[0] = REPORT_ID_KEYBOARD;
+    report[1] = reportBuffer[0];
+    memcpy(report + 2, reportBuffer + 2, 6);
+    return 8;
+  }
+#endif
 
   using Print::write;
 
   friend USB_PUBLIC usbMsgLen_t usbFunctionSetup(uchar data[8]);
+  friend USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len);
 } Keyboard;
 
 USB_PUBLIC usbMsgLen_t usbFunctionSetup(uchar data[8]) {
@@ -123,20 +697,50 @@ USB_PUBLIC usbMsgLen_t usbFunctionSetup(uchar data[8]) {
 
     if (rq->bRequest == USBRQ_HID_GET_REPORT) {
       /* wValue: ReportType (highbyte), ReportID (lowbyte)
-         We only have one report type, so don't look at wValue */
+         We only have input reports, so don't look at the type */
+#if TINY_KEYBOARD_COMPOSITE
+      if (usbKeyboardProtocol) {
+        usbMsgPtr = reportReply;
+        return Keyboard.getReport(rq->wValue.bytes[0], reportReply);
+      }
+#endif
       usbMsgPtr = Keyboard.reportBuffer;
       return sizeof(Keyboard.reportBuffer);
     } else if (rq->bRequest == USBRQ_HID_GET_IDLE) {
       usbMsgPtr = &idleRate;
       return 1;
     } else if (rq->bRequest == USBRQ_HID_SET_IDLE) {
-      idleRate = rq->wValue.bytes[1];
+      /* the keyboard's (ID 0 means all reports) */
+      if (rq->wValue.bytes[0] <= REPORT_ID_KEYBOARD) idleRate = rq->wValue.bytes[1];
+    } else if (rq->bRequest == USBRQ_HID_SET_REPORT) {
+      /* the LED output report comes in the data stage */
+      return rq->wLength.word ? USB_NO_MSG : 0;
+    } else if (rq->bRequest == USBRQ_HID_GET_PROTOCOL) {
+      usbMsgPtr = &usbKeyboardProtocol;
+      return 1;
+    } else if (rq->bRequest == USBRQ_HID_SET_PROTOCOL) {
+      usbKeyboardProtocol = rq->wValue.bytes[0];
     }
   } else {
-    /* no vendor specific requests implemented */
+    /* the only vendor request restarts into the bootloader */
+    TinyBootloader::handleSetup(rq);
   }
   
   return 0;
 }
 
+/* the LED output report of SET_REPORT; it is a single byte, after the report
+ * ID in the report protocol of the composite device */
+USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len) {
+#if TINY_KEYBOARD_COMPOSITE
+  if (usbKeyboardProtocol && len) {
+    if (data[0] != REPORT_ID_KEYBOARD) return 1;
+    data++;
+    len--;
+  }
+#endif
+  if (len) Keyboard.ledState = data[0];
+  return 1;
+}
+
 #endif // __TinyKeyboard_h__
\ No newline at end of file
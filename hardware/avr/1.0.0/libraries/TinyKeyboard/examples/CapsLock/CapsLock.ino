@@ -0,0 +1,19 @@
+#include <TinyKeyboard.h>
+
+// lights the LED on pin 1 (on the Digispark) while Caps Lock is on
+void showLeds(uint8_t leds) {
+  digitalWrite(1, leds & LED_CAPS_LOCK ? HIGH : LOW);
+}
+
+void setup() {
+  Keyboard.begin();
+  pinMode(1, OUTPUT);
+  Keyboard.onLedChange(showLeds);
+}
+
+
+void loop() {
+  // comes out as written whether Caps Lock is on or not
+  Keyboard.type(KSTR("Caps Lock makes no difference\n"));
+  Keyboard.delay(5000);
+}
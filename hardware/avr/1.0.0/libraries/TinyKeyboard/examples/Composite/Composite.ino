@@ -0,0 +1,24 @@
+#include <TinyKeyboard.h>
+
+#if !TINY_KEYBOARD_COMPOSITE
+#error "select Tools > USB device > Keyboard, media keys and mouse"
+#endif
+
+void setup() {
+  Keyboard.begin();
+}
+
+
+void loop() {
+  // all three go out together, taking turns for reports
+  Keyboard.type(KSTR("Volume down, and round in a square\n"));
+  Keyboard.sendConsumerKey(CONSUMER_VOLUME_DOWN);
+  for (int8_t side = 0; side < 4; side++) {
+    for (uint8_t step = 0; step < 20; step++) {
+      Keyboard.moveMouse(side == 0 ? 5 : side == 2 ? -5 : 0, side == 1 ? 5 : side == 3 ? -5 : 0);
+      Keyboard.delay(10);
+    }
+  }
+  Keyboard.sendConsumerKey(CONSUMER_VOLUME_UP);
+  Keyboard.delay(5000);
+}
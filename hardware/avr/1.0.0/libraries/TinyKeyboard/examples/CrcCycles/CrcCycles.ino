@@ -0,0 +1,94 @@
+// Times usbCrc16(), which usbPoll() runs on every data packet it sends.
+// Select the version with Tools > USB CRC and open a text editor; the sketch
+// types the fewest and most cycles for an 8 byte packet over random data.
+// That is a few cycles more than usbdrv/extras/cycles (make crc) reports:
+// the call is included. The sketch takes timer1 over at the CPU clock.
+#include <TinyKeyboard.h>
+
+#if defined(TCCR1)
+// ATtiny25/45/85: timer1 has only 8 bits, the core's timer0 (prescaler 64)
+// counts its wraps
+typedef struct { uint8_t coarse, fine; } Time;
+
+Time now() {
+  Time t;
+  uint8_t sreg = SREG;
+  cli();
+  t.coarse = TCNT0;
+  t.fine = TCNT1;
+  SREG = sreg;
+  return t;
+}
+
+uint16_t cycles(Time from, Time to) {
+  uint16_t approx = (uint8_t)(to.coarse - from.coarse) * 64;
+  uint8_t fine = to.fine - from.fine;
+  return approx + (int8_t)(fine - (uint8_t)approx);
+}
+#else
+typedef uint16_t Time;
+
+Time now() {
+  uint8_t sreg = SREG;
+  cli();
+  Time t = TCNT1;
+  SREG = sreg;
+  return t;
+}
+
+uint16_t cycles(Time from, Time to) {
+  return to - from;
+}
+#endif
+
+uchar packet[8];
+
+// interrupts only ever add cycles: the fewest of a few tries is the call
+uint16_t timeCrc(uint16_t overhead) {
+  uint16_t fewest = 0xffff;
+  for (uint8_t i = 0; i < 8; i++) {
+    Time start = now();
+    usbCrc16(packet, sizeof(packet));
+    Time end = now();
+    fewest = min(fewest, cycles(start, end) - overhead);
+  }
+  return fewest;
+}
+
+void setup() {
+  Keyboard.begin();
+#if defined(TCCR1)
+  GTCCR &= ~_BV(PWM1B);
+  TCCR1 = _BV(CS10);
+#else
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+#endif
+}
+
+
+void loop() {
+  uint16_t overhead = 0xffff, fewest = 0xffff, most = 0;
+
+  for (uint8_t i = 0; i < 8; i++) {
+    Time start = now();
+    Time end = now();
+    overhead = min(overhead, cycles(start, end));
+  }
+  // the small version takes longer for some data than for other
+  for (uint8_t n = 0; n < 64; n++) {
+    for (uint8_t i = 0; i < sizeof(packet); i++) packet[i] = random(256);
+    uint16_t c = timeCrc(overhead);
+    fewest = min(fewest, c);
+    most = max(most, c);
+  }
+
+  Keyboard.print(F("usbCrc16 USB_USE_FAST_CRC="));
+  Keyboard.print(USB_USE_FAST_CRC);
+  Keyboard.print(F(": 8 bytes in "));
+  Keyboard.print(fewest);
+  Keyboard.print('-');
+  Keyboard.print(most);
+  Keyboard.println(F(" cycles"));
+  Keyboard.delay(5000);
+}
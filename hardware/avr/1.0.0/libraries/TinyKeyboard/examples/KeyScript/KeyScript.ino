@@ -0,0 +1,22 @@
+#include <TinyKeyboard.h>
+
+// compiled from script.txt by extras/keyscript
+#include "script.h"
+
+void setup() {
+  Keyboard.begin();
+  // give the host time to set the keyboard up
+  Keyboard.delay(1000);
+  Keyboard.play(script);
+}
+
+
+void loop() {
+  // the script plays from update() while the sketch goes on
+  Keyboard.update();
+
+  if (!Keyboard.playing()) {
+    Keyboard.delay(10000);
+    Keyboard.play(script);
+  }
+}
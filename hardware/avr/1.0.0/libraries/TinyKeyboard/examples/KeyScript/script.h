@@ -0,0 +1,24 @@
+// Generated by extras/keyscript from script.txt. Edit that and run make there.
+
+#ifndef __script_h__
+#define __script_h__
+
+const uint8_t script[] PROGMEM = {
+  KS_TEXT, 'T', 'y', 'p', 'e', 'd', ' ', 'f', 'r', 'o', 'm', ' ', 'a', ' ', 'k', 'e', 'y', ' ', 's', 'c', 'r', 'i', 'p', 't', ' ', 'i', 'n', ' ', 'f', 'l', 'a', 's', 'h', '.', '\n', 0, // 3: line Typed from a key script in flash.
+  KS_REPEAT, 3,                             // 4: repeat 3
+  KS_TEXT, 'L', 'i', 'n', 'e', 0,           // 5: type Line
+  KS_TAP, KC_TAB,                           // 6: tap TAB
+  KS_TEXT, 't', 'h', 'r', 'e', 'e', ' ', 't', 'i', 'm', 'e', 's', ',', ' ', 'w', 'i', 't', 'h', ' ', 'a', ' ', 't', 'a', 'b', '\n', 0, // 7: line three times, with a tab
+  KS_NEXT,                                  // 8: next
+  KS_DELAY_MS(1000),                        // 9: delay 1000
+  KS_TEXT, 'o', 'o', 'p', 's', 0,           // 11: type oops
+  KS_MODIFIERS, LEFT_CONTROL | LEFT_SHIFT,  // 12: mods LEFT_CONTROL LEFT_SHIFT
+  KS_TAP, KC_LEFT,                          // 13: tap LEFT
+  KS_MODIFIERS, 0,                          // 14: mods none
+  KS_TEXT, 'd', 'o', 'n', 'e', '\n', 0,     // 15: line done
+  KS_END
+};
+
+// 96 bytes
+
+#endif // __script_h__
@@ -1,11 +1,13 @@
 #include <TinyKeyboard.h>
 
 void setup() {
-  // no setup needed
+  // USB connects while the sketch goes on; the first update() would too
+  Keyboard.begin();
 }
 
 
 void loop() {
-  Keyboard.println("Hello, World!");
+  // KSTR() translates the text to key codes while compiling
+  Keyboard.type(KSTR("Hello, World!\n"));
   Keyboard.delay(5000);
 }
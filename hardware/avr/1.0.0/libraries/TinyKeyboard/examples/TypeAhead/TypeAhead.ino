@@ -0,0 +1,27 @@
+#include <TinyKeyboard.h>
+
+// Types the highest reading of A1 every second. println() only fills the
+// type-ahead buffer, so the sketch keeps sampling while the text is typed;
+// update() sends it, and must be called often.
+
+unsigned highest;
+unsigned long next;
+
+void setup() {
+  Keyboard.begin();
+}
+
+
+void loop() {
+  Keyboard.update();
+
+  unsigned value = analogRead(A1);
+  if (value > highest) highest = value;
+
+  // "1023\r\n" takes 6 characters of the buffer
+  if ((long)(millis() - next) >= 0 && Keyboard.availableForWrite() >= 6) {
+    Keyboard.println(highest);
+    highest = 0;
+    next += 1000;
+  }
+}
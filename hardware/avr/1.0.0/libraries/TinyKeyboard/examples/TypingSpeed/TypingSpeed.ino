@@ -0,0 +1,21 @@
+#include <TinyKeyboard.h>
+
+// Types 100 lines of letters and digits as fast as the host takes them, for
+// extras/keybench, which measures the rate and the jitter. Start keybench
+// first and plug the board in after: keybench grabs the keyboard, so the
+// text doesn't end up in a window. Tools > USB poll interval sets the rate.
+
+void setup() {
+  Keyboard.begin();
+  Keyboard.delay(1000);   // for the host to set the keyboard up
+
+  for (uint8_t i = 0; i < 100; i++) {
+    Keyboard.print(F("abcdefghijklmnopqrstuvwxyz0123456789\n"));
+  }
+  Keyboard.flush();
+}
+
+
+void loop() {
+  Keyboard.update();
+}
@@ -0,0 +1,344 @@
+/* Name: keybench.c
+ * Project: TinyKeyboard host utility
+ * Tabsize: 4
+ * License: GNU GPL v2 (see hardware/avr/1.0.0/libraries/usbdrv/License.txt), GNU GPL v3
+ *
+ *   keybench [-n count] [-u ms]
+ *
+ * Measures how fast a TinyKeyboard sketch types, from the input events Linux
+ * makes of its reports. See Makefile.
+ */
+
+/*
+General Description:
+The keyboard is found among /dev/input/event* by the name "TinyKeyboard" and
+grabbed, so what it types goes nowhere else while keybench runs. keybench
+waits for it to appear: start it, then plug in a board running the
+TypingSpeed example, which types lines of
+
+  abcdefghijklmnopqrstuvwxyz0123456789
+
+keybench reads key positions, not characters, so build the example with
+Tools > Keyboard layout set to US. Counting starts at the first end of line. After count characters (2000 by
+default) keybench prints the characters per second, the characters that
+didn't follow the pattern, and the time between successive reports that
+pressed or released keys: minimum, median, 99th percentile, maximum and the
+standard deviation (the jitter). The times are the kernel's, taken when each
+report arrived. The poll interval the device asks for (bInterval) is read
+from sysfs; hosts round it down to a power of two.
+
+With -u, keybench types the lines itself through a uinput keyboard named
+"keybench loopback", one report every ms milliseconds and packed like
+TinyKeyboard packs them, and measures that instead. It checks the tool and
+shows how much jitter the host adds without any USB in the way.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <math.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+#define DEVICE_NAME         "TinyKeyboard"
+#define LOOPBACK_NAME       "keybench loopback"
+#define PATTERN             "abcdefghijklmnopqrstuvwxyz0123456789\n"
+#define KEYS_PER_REPORT     6       /* TINY_KEYBOARD_KEYS_PER_REPORT */
+#define IDLE_TIMEOUT_MS     3000
+
+#ifndef input_event_sec     /* before Linux 4.16 */
+#define input_event_sec     time.tv_sec
+#define input_event_usec    time.tv_usec
+#endif
+
+/* characters of the unshifted US layout by Linux key code, 0 for keys that
+ * don't type one
+ */
+static const char keyChars[] =
+    "\0\0" "1234567890-=\b\t"
+    "qwertyuiop[]\n\0"
+    "asdfghjkl;'`\0\\"
+    "zxcvbnm,./\0\0\0 ";
+
+static char keyChar(int code)
+{
+    return code < (int)sizeof(keyChars) - 1 ? keyChars[code] : 0;
+}
+
+static int keyCode(char c)
+{
+int     code;
+
+    for(code = 1; code < (int)sizeof(keyChars) - 1; code++){
+        if(keyChars[code] == c)
+            return code;
+    }
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: keybench [-n count] [-u ms]\n");
+    exit(2);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* opens the first event device with name in its name and returns its number
+ * in *number, or -1 if there is none
+ */
+static int openDevice(const char *name, int *number)
+{
+char    path[32], devName[256];
+int     i, fd;
+
+    for(i = 0; i < 64; i++){
+        snprintf(path, sizeof(path), "/dev/input/event%d", i);
+        if((fd = open(path, O_RDONLY)) < 0)
+            continue;
+        if(ioctl(fd, EVIOCGNAME(sizeof(devName)), devName) > 0 && strstr(devName, name)){
+            *number = i;
+            return fd;
+        }
+        close(fd);
+    }
+    return -1;
+}
+
+/* bInterval of interrupt-in endpoint 1 of the USB interface the event device
+ * belongs to, or -1 if it isn't a USB device
+ */
+static int readInterval(int number)
+{
+char    path[96];
+FILE    *f;
+int     interval = -1;
+
+    snprintf(path, sizeof(path), "/sys/class/input/event%d/device/device/../ep_81/bInterval", number);
+    if((f = fopen(path, "r"))){
+        if(fscanf(f, "%x", &interval) != 1)
+            interval = -1;
+        fclose(f);
+    }
+    return interval;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void emit(int fd, int type, int code, int value)
+{
+struct input_event  ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = type;
+    ev.code = code;
+    ev.value = value;
+    if(write(fd, &ev, sizeof(ev)) != sizeof(ev))
+        exit(1);
+}
+
+static void sleepUntil(struct timespec *t, long ms)
+{
+    t->tv_nsec += ms * 1000000;
+    while(t->tv_nsec >= 1000000000){
+        t->tv_nsec -= 1000000000;
+        t->tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, t, NULL);
+}
+
+/* the child of -u: a uinput keyboard that types PATTERN until killed, a
+ * report every ms milliseconds
+ */
+static void loopback(long ms)
+{
+struct uinput_user_dev  dev;
+struct timespec         t;
+const char              *p;
+int                     fd, keys[KEYS_PER_REPORT], n, i;
+
+    if((fd = open("/dev/uinput", O_WRONLY)) < 0){
+        perror("keybench: /dev/uinput");
+        exit(1);
+    }
+    ioctl(fd, UI_SET_EVBIT, EV_KEY);
+    for(p = PATTERN; *p; p++)
+        ioctl(fd, UI_SET_KEYBIT, keyCode(*p));
+    memset(&dev, 0, sizeof(dev));
+    snprintf(dev.name, sizeof(dev.name), LOOPBACK_NAME);
+    dev.id.bustype = BUS_VIRTUAL;
+    if(write(fd, &dev, sizeof(dev)) != sizeof(dev) || ioctl(fd, UI_DEV_CREATE) < 0){
+        perror("keybench: uinput");
+        exit(1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    sleepUntil(&t, 500);    /* for the parent to find and grab it */
+    for(p = PATTERN;;){
+        /* a run of distinct keys, pressed together and released together */
+        for(n = 0; n < KEYS_PER_REPORT && *p; p++){
+            int code = keyCode(*p);
+            for(i = 0; i < n && keys[i] != code; i++)
+                ;
+            if(i < n)
+                break;
+            keys[n++] = code;
+        }
+        for(i = 0; i < n; i++)
+            emit(fd, EV_KEY, keys[i], 1);
+        emit(fd, EV_SYN, SYN_REPORT, 0);
+        sleepUntil(&t, ms);
+        for(i = 0; i < n; i++)
+            emit(fd, EV_KEY, keys[i], 0);
+        emit(fd, EV_SYN, SYN_REPORT, 0);
+        sleepUntil(&t, ms);
+        if(!*p)
+            p = PATTERN;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int compareDouble(const void *a, const void *b)
+{
+double  x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double eventTime(const struct input_event *ev)
+{
+    return ev->input_event_sec + ev->input_event_usec / 1e6;
+}
+
+/* reads the device until count characters have been typed after the first
+ * end of line and prints the results
+ */
+static int measure(int fd, int count, int interval)
+{
+struct input_event  ev;
+struct pollfd       pfd = { fd, POLLIN, 0 };
+int                 maxGaps = 2 * count;
+double              *gaps = malloc(maxGaps * sizeof(double));
+double              first = 0, last = 0, lastReport = 0, sum = 0, sumSquares = 0, seconds;
+const char          *expect = NULL;
+int                 chars = 0, errors = 0, reports = 0, n = 0, changed = 0, i;
+
+    if(!gaps){
+        perror("keybench");
+        return 1;
+    }
+    while(chars < count){
+        if(poll(&pfd, 1, IDLE_TIMEOUT_MS) <= 0 || read(fd, &ev, sizeof(ev)) != sizeof(ev)){
+            fprintf(stderr, "keybench: the keyboard stopped typing after %d characters\n", chars);
+            free(gaps);
+            return 1;
+        }
+        if(ev.type == EV_KEY && ev.value != 2){     /* 2 is autorepeat */
+            char c = keyChar(ev.code);
+            changed = 1;
+            if(ev.value != 1 || !c)
+                continue;
+            if(!expect){
+                if(c == '\n')
+                    expect = PATTERN;       /* counting starts here */
+                continue;
+            }
+            if(c != *expect){
+                const char *p = strchr(PATTERN, c);
+                errors++;
+                expect = p ? p : PATTERN - 1;
+            }
+            if(!*++expect)
+                expect = PATTERN;
+            if(chars++ == 0)
+                first = eventTime(&ev);
+            last = eventTime(&ev);
+        }else if(ev.type == EV_SYN && ev.code == SYN_REPORT && changed){
+            double t = eventTime(&ev);
+            if(chars > 0){
+                if(n < maxGaps)
+                    gaps[n++] = (t - lastReport) * 1000;
+                reports++;
+            }
+            lastReport = t;
+            changed = 0;
+        }
+    }
+    seconds = last - first;
+    if(interval > 0)
+        printf("interval %d ms: ", interval);
+    printf("%d characters in %.2f s, %.1f characters/s, %d out of sequence\n", chars, seconds,
+           seconds > 0 ? (chars - 1) / seconds : 0, errors);
+    if(n > 0){
+        for(i = 0; i < n; i++){
+            sum += gaps[i];
+            sumSquares += gaps[i] * gaps[i];
+        }
+        qsort(gaps, n, sizeof(double), compareDouble);
+        printf("%d reports apart: min %.2f  median %.2f  p99 %.2f  max %.2f ms, jitter %.2f ms\n", reports,
+               gaps[0], gaps[n / 2], gaps[(n * 99 - 1) / 100], gaps[n - 1],
+               sqrt(sumSquares / n - (sum / n) * (sum / n)));
+    }
+    free(gaps);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+const char  *name = DEVICE_NAME;
+int         i, count = 2000, fd, number, result;
+long        ms = 0;
+pid_t       child = 0;
+
+    for(i = 1; i < argc; i++){
+        if(i + 1 < argc && strcmp(argv[i], "-n") == 0){
+            count = atoi(argv[++i]);
+        }else if(i + 1 < argc && strcmp(argv[i], "-u") == 0){
+            ms = atol(argv[++i]);
+            if(ms < 1)
+                usage();
+        }else{
+            usage();
+        }
+    }
+    if(count < 2){
+        fprintf(stderr, "keybench: count must be at least 2\n");
+        return 2;
+    }
+    if(ms){
+        name = LOOPBACK_NAME;
+        if((child = fork()) == 0)
+            loopback(ms);
+    }
+
+    if((fd = openDevice(name, &number)) < 0){
+        fprintf(stderr, "keybench: waiting for %s\n", name);
+        while((fd = openDevice(name, &number)) < 0){
+            if(child && waitpid(child, NULL, WNOHANG) == child)
+                return 1;   /* it couldn't create the device */
+            usleep(100000);
+        }
+    }
+    if(ioctl(fd, EVIOCGRAB, 1) == 0){
+        result = measure(fd, count, ms ? ms : readInterval(number));
+        ioctl(fd, EVIOCGRAB, 0);
+    }else{
+        perror("keybench: can't grab the keyboard");
+        result = 1;
+    }
+    close(fd);
+    if(child){
+        kill(child, SIGTERM);
+        waitpid(child, NULL, 0);
+    }
+    return result;
+}
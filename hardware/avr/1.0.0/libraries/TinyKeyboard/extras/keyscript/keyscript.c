@@ -0,0 +1,330 @@
+/* Name: keyscript.c
+ * Project: TinyKeyboard host utility
+ * Tabsize: 4
+ * License: GNU GPL v2 (see hardware/avr/1.0.0/libraries/usbdrv/License.txt), GNU GPL v3
+ *
+ *   keyscript keycode.h script.txt > script.h
+ *
+ * Compiles a key script written as text into the PROGMEM array
+ * Keyboard.play() types. See Makefile and key_script.h.
+ */
+
+/*
+General Description:
+A script has an instruction per line. '#' at the start of a line begins a
+comment; empty lines are ignored.
+
+  type text       types the rest of the line after the space; \n, \t and \\
+                  stand for a new line, a tab and a backslash
+  line text       the same with a new line at the end
+  tap KEY...      presses and releases each key in turn
+  press KEY       presses a key until the next instruction that sends one
+  release         releases it
+  mods MOD...     holds these modifiers for the keys that follow; "mods none"
+                  lets go of them. Text brings its own.
+  delay MS        waits until everything before has been typed, then MS
+                  milliseconds
+  repeat N        runs the lines up to "next" N times (1 to 255), not nested
+  next
+
+Keys are the KC_ names of keycode.h, with or without KC_: tap ENTER. The
+modifiers are LEFT_CONTROL, LEFT_SHIFT, LEFT_ALT, LEFT_GUI and their RIGHT_
+twins. For example:
+
+  mods LEFT_GUI
+  tap R
+  mods none
+  delay 500
+  line notepad
+
+Text is stored as ASCII and looked up in the layout the sketch is built for,
+so a script works with any of them. The header is written to standard
+output, with an array named after the script file; every error is reported
+with its line number.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MAX_NAMES   1024
+
+static const char   *modifierNames[] = {
+    "LEFT_CONTROL", "LEFT_SHIFT", "LEFT_ALT", "LEFT_GUI", "RIGHT_CONTROL", "RIGHT_SHIFT", "RIGHT_ALT", "RIGHT_GUI"
+};
+
+static char     *keyNames[MAX_NAMES];
+static int      keyNameCount;
+
+static const char   *fileName;
+static int          lineNumber, errors, bytes;
+static int          repeatLine;         /* line of the open "repeat", 0 if none */
+
+static void error(const char *message, const char *word)
+{
+    fprintf(stderr, "%s:%d: %s%s%s\n", fileName, lineNumber, message, word ? ": " : "", word ? word : "");
+    errors++;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* collects every identifier starting with KC_ in keycode.h */
+static int readKeyNames(const char *path)
+{
+FILE    *f = fopen(path, "r");
+char    line[256], *p;
+
+    if(!f){
+        perror(path);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), f)){
+        for(p = line; (p = strstr(p, "KC_")) != NULL;){
+            int n = 0;
+            if(p > line && (isalnum((unsigned char)p[-1]) || p[-1] == '_')){
+                p += 3;
+                continue;
+            }
+            while(isalnum((unsigned char)p[n]) || p[n] == '_')
+                n++;
+            if(keyNameCount < MAX_NAMES)
+                keyNames[keyNameCount++] = strndup(p, n);
+            p += n;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+/* the KC_ name of a key, with or without the prefix, or NULL */
+static const char *keyName(const char *word)
+{
+char    name[64];
+int     i;
+
+    snprintf(name, sizeof(name), "%s%s", strncmp(word, "KC_", 3) == 0 ? "" : "KC_", word);
+    for(i = 0; i < keyNameCount; i++){
+        if(strcmp(keyNames[i], name) == 0)
+            return keyNames[i];
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* writes one instruction: its bytes, then the source line as a comment */
+static void emit(const char *code, int length, const char *source)
+{
+    printf("  %s, %*s// %d: %s\n", code, (int)(strlen(code) < 40 ? 40 - strlen(code) : 0), "", lineNumber, source);
+    bytes += length;
+}
+
+static void emitKey(const char *op, const char *word, const char *source)
+{
+const char  *name = keyName(word);
+char        code[96];
+
+    if(!name){
+        error("not a key in keycode.h", word);
+        return;
+    }
+    snprintf(code, sizeof(code), "%s, %s", op, name);
+    emit(code, 2, source);
+}
+
+static void emitText(const char *text, int newLine, const char *source)
+{
+char    *code = malloc(8 * strlen(text) + 32), *p = code;
+int     length = 2;
+
+    p += sprintf(p, "KS_TEXT");
+    for(; *text || newLine; text++){
+        int ch = *text;
+        if(!ch){
+            ch = '\n';
+            newLine = 0;
+            text--;
+        }else if(ch == '\\'){
+            ch = *++text;
+            if(ch == 'n')
+                ch = '\n';
+            else if(ch == 't')
+                ch = '\t';
+            else if(ch != '\\'){
+                error("unknown escape, not \\n, \\t or \\\\", NULL);
+                text--;
+                continue;
+            }
+        }
+        if(ch & 0x80){
+            error("not an ASCII character in", source);
+            break;
+        }
+        if(ch == '\n')
+            p += sprintf(p, ", '\\n'");
+        else if(ch == '\t')
+            p += sprintf(p, ", '\\t'");
+        else if(ch == '\'' || ch == '\\')
+            p += sprintf(p, ", '\\%c'", ch);
+        else if(ch < ' ' || ch == 127)
+            p += sprintf(p, ", %d", ch);
+        else
+            p += sprintf(p, ", '%c'", ch);
+        length++;
+    }
+    p += sprintf(p, ", 0");
+    emit(code, length, source);
+    free(code);
+}
+
+static void emitModifiers(char **words, int count, const char *source)
+{
+char    code[256] = "KS_MODIFIERS, ";
+int     i, m;
+
+    if(count == 1 && strcmp(words[0], "none") == 0){
+        strcat(code, "0");
+    }else if(count == 0){
+        error("mods needs modifiers or none", NULL);
+        return;
+    }else{
+        for(i = 0; i < count; i++){
+            for(m = 0; m < 8 && strcmp(words[i], modifierNames[m]) != 0; m++)
+                ;
+            if(m == 8){
+                error("not a modifier", words[i]);
+                return;
+            }
+            if(i > 0)
+                strcat(code, " | ");
+            strcat(code, modifierNames[m]);
+        }
+    }
+    emit(code, 2, source);
+}
+
+static int number(const char *word, long min, long max, long *value)
+{
+char    *end;
+
+    *value = word ? strtol(word, &end, 10) : 0;
+    if(!word || *end || *value < min || *value > max){
+        char range[64];
+        snprintf(range, sizeof(range), "a number from %ld to %ld", min, max);
+        error("needs", range);
+        return 0;
+    }
+    return 1;
+}
+
+static void parseLine(char *line)
+{
+char    source[1024], *words[32], *command, *rest;
+int     count = 0, i;
+long    value;
+
+    line[strcspn(line, "\r\n")] = 0;
+    if(line[0] == '#')
+        return;
+    snprintf(source, sizeof(source), "%s", line);
+    for(command = line; *command == ' ' || *command == '\t'; command++)
+        ;
+    if(!*command)
+        return;
+    rest = command + strcspn(command, " \t");
+    if(*rest)
+        *rest++ = 0;
+
+    if(strcmp(command, "type") == 0 || strcmp(command, "line") == 0){
+        emitText(rest, command[0] == 'l', source);
+        return;
+    }
+    for(words[0] = strtok(rest, " \t"); words[count] && count < 31; words[count] = strtok(NULL, " \t"))
+        count++;
+
+    if(strcmp(command, "tap") == 0){
+        if(count == 0)
+            error("tap needs a key", NULL);
+        for(i = 0; i < count; i++)
+            emitKey("KS_TAP", words[i], source);
+    }else if(strcmp(command, "press") == 0){
+        if(count != 1)
+            error("press needs one key", NULL);
+        else
+            emitKey("KS_PRESS", words[0], source);
+    }else if(strcmp(command, "release") == 0){
+        emit("KS_RELEASE", 1, source);
+    }else if(strcmp(command, "mods") == 0){
+        emitModifiers(words, count, source);
+    }else if(strcmp(command, "delay") == 0){
+        if(number(count == 1 ? words[0] : NULL, 0, 3600000, &value)){
+            do{     /* a delay takes up to 65535 ms */
+                char code[64];
+                long ms = value > 65535 ? 65535 : value;
+                snprintf(code, sizeof(code), "KS_DELAY_MS(%ld)", ms);
+                emit(code, 3, source);
+                value -= ms;
+            }while(value > 0);
+        }
+    }else if(strcmp(command, "repeat") == 0){
+        if(repeatLine){
+            char previous[32];
+            snprintf(previous, sizeof(previous), "line %d", repeatLine);
+            error("repeats don't nest; the open one is on", previous);
+        }else if(number(count == 1 ? words[0] : NULL, 1, 255, &value)){
+            char code[32];
+            snprintf(code, sizeof(code), "KS_REPEAT, %ld", value);
+            emit(code, 2, source);
+            repeatLine = lineNumber;
+        }
+    }else if(strcmp(command, "next") == 0){
+        if(!repeatLine)
+            error("next without repeat", NULL);
+        emit("KS_NEXT", 1, source);
+        repeatLine = 0;
+    }else{
+        error("unknown instruction", command);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+FILE        *f;
+char        line[1024], name[64];
+const char  *base;
+int         i;
+
+    if(argc != 3){
+        fprintf(stderr, "usage: keyscript keycode.h script.txt > script.h\n");
+        return 2;
+    }
+    if(readKeyNames(argv[1]) != 0)
+        return 1;
+    fileName = argv[2];
+    if(!(f = fopen(fileName, "r"))){
+        perror(fileName);
+        return 1;
+    }
+    base = strrchr(fileName, '/') ? strrchr(fileName, '/') + 1 : fileName;
+    for(i = 0; base[i] && base[i] != '.' && i < (int)sizeof(name) - 1; i++)
+        name[i] = isalnum((unsigned char)base[i]) ? base[i] : '_';
+    name[i] = 0;
+
+    printf("// Generated by extras/keyscript from %s. Edit that and run make there.\n\n", base);
+    printf("#ifndef __%s_h__\n#define __%s_h__\n\n", name, name);
+    printf("const uint8_t %s[] PROGMEM = {\n", name);
+    while(fgets(line, sizeof(line), f)){
+        lineNumber++;
+        parseLine(line);
+    }
+    fclose(f);
+    if(repeatLine){
+        lineNumber = repeatLine;
+        error("repeat without next", NULL);
+    }
+    printf("  KS_END\n};\n\n// %d bytes\n\n#endif // __%s_h__\n", bytes + 1, name);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,224 @@
+/* Name: layoutgen.c
+ * Project: TinyKeyboard host utility
+ * Tabsize: 4
+ * License: GNU GPL v2 (see hardware/avr/1.0.0/libraries/usbdrv/License.txt), GNU GPL v3
+ *
+ *   layoutgen keycode.h layout.txt > layout_name.h
+ *
+ * Turns the description of a keyboard layout into the ascii_to_keycode table
+ * TinyKeyboard types with. See Makefile.
+ */
+
+/*
+General Description:
+A layout description has a line for each ASCII character the layout can type:
+the character, the key that types it (a KC_ name from keycode.h, for the key
+at that position on a US keyboard) and the modifiers it needs, if any:
+
+  shift   with shift held
+  altgr   with AltGr (right Alt) held
+  dead    the key is a dead key: TinyKeyboard types a space after it, which
+          makes the host type the accent on its own
+
+Characters that need a name are written as BS, TAB, LF, ESC, SPACE, DEL and
+HASH, because '#' starts a comment. Characters without a line are
+typed as nothing, and KSTR() refuses them. For example:
+
+  @       KC_Q        altgr
+  `       KC_EQUAL    shift dead
+
+The header is written to standard output. It has a table of 128 16-bit
+entries: the key code in the low byte, with bit 7 for a dead key, and the
+modifier byte of the report in the high byte. Letters (A to Z, a to z) get
+the LETTER() mark in the high byte, so that TinyKeyboard can toggle shift for
+them while Caps Lock is on. ascii_keycode_table.h includes
+the one TINY_KEYBOARD_LAYOUT selects. The key names are checked against
+keycode.h; every line is checked for duplicates and unknown words.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MAX_NAMES   1024
+
+static const char   *asciiNames[33] = {
+    "NUL", "SOH", "STX", "ETX", "EOT", "ENQ", "ACK", "BEL", "BS", "TAB", "LF", "VT", "FF", "CR", "SO", "SI",
+    "DLE", "DC1", "DC2", "DC3", "DC4", "NAK", "SYN", "ETB", "CAN", "EM", "SUB", "ESC", "FS", "GS", "RS", "US",
+    "Space"
+};
+
+static char     *keyNames[MAX_NAMES];
+static int      keyNameCount;
+
+static char     *entries[128];          /* the C expression for each character */
+static int      entryLines[128];
+
+static const char   *fileName;
+static int          lineNumber, errors;
+
+static void error(const char *message, const char *word)
+{
+    fprintf(stderr, "%s:%d: %s%s%s\n", fileName, lineNumber, message, word ? ": " : "", word ? word : "");
+    errors++;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* collects every identifier starting with KC_ in keycode.h */
+static int readKeyNames(const char *path)
+{
+FILE    *f = fopen(path, "r");
+char    line[256], *p;
+
+    if(!f){
+        perror(path);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), f)){
+        for(p = line; (p = strstr(p, "KC_")) != NULL;){
+            int n = 0;
+            if(p > line && (isalnum((unsigned char)p[-1]) || p[-1] == '_')){
+                p += 3;
+                continue;
+            }
+            while(isalnum((unsigned char)p[n]) || p[n] == '_')
+                n++;
+            if(keyNameCount < MAX_NAMES)
+                keyNames[keyNameCount++] = strndup(p, n);
+            p += n;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static int isKeyName(const char *name)
+{
+int     i;
+
+    for(i = 0; i < keyNameCount; i++){
+        if(strcmp(keyNames[i], name) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/* the ASCII code a description line starts with, or -1 */
+static int parseCharacter(const char *word)
+{
+static const struct { const char *name; int code; } names[] = {
+    { "BS", 8 }, { "TAB", 9 }, { "LF", 10 }, { "ESC", 27 }, { "SPACE", 32 }, { "DEL", 127 }, { "HASH", '#' }
+};
+unsigned    i;
+
+    for(i = 0; i < sizeof(names) / sizeof(names[0]); i++){
+        if(strcmp(word, names[i].name) == 0)
+            return names[i].code;
+    }
+    if(strlen(word) == 1 && word[0] > ' ' && word[0] < 127)
+        return word[0];
+    return -1;
+}
+
+static void parseLine(char *line)
+{
+char    *words[8], *hash, expression[64];
+int     count = 0, ch, i, shift = 0, altgr = 0, dead = 0;
+
+    if((hash = strchr(line, '#')))
+        *hash = 0;
+    for(words[0] = strtok(line, " \t\r\n"); words[count] && count < 7; words[count] = strtok(NULL, " \t\r\n"))
+        count++;
+    if(count == 0)
+        return;
+    if((ch = parseCharacter(words[0])) < 0){
+        error("not a character or character name", words[0]);
+        return;
+    }
+    if(count < 2){
+        error("no key for", words[0]);
+        return;
+    }
+    if(!isKeyName(words[1])){
+        error("not a key in keycode.h", words[1]);
+        return;
+    }
+    for(i = 2; i < count; i++){
+        if(strcmp(words[i], "shift") == 0)
+            shift = 1;
+        else if(strcmp(words[i], "altgr") == 0)
+            altgr = 1;
+        else if(strcmp(words[i], "dead") == 0)
+            dead = 1;
+        else
+            error("unknown modifier", words[i]);
+    }
+    if(entries[ch]){
+        char previous[32];
+        snprintf(previous, sizeof(previous), "line %d", entryLines[ch]);
+        error("character already defined on", previous);
+        return;
+    }
+    snprintf(expression, sizeof(expression), "%s%s%s%s%s%s%s%s%s", isalpha(ch) ? "LETTER(" : "",
+             shift ? "SHIFT(" : "", altgr ? "ALTGR(" : "", dead ? "DEAD(" : "", words[1],
+             dead ? ")" : "", altgr ? ")" : "", shift ? ")" : "", isalpha(ch) ? ")" : "");
+    entries[ch] = strdup(expression);
+    entryLines[ch] = lineNumber;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void writeHeader(const char *name)
+{
+int     i;
+
+    printf("// Generated by extras/layoutgen from %s.txt. Edit that and run make there.\n\n", name);
+    printf("#ifndef __layout_%s_h__\n#define __layout_%s_h__\n\n", name, name);
+    printf("constexpr uint16_t ascii_to_keycode[] PROGMEM = {\n");
+    for(i = 0; i < 128; i++){
+        char label[8];
+        if(i < 33)
+            snprintf(label, sizeof(label), "%s", asciiNames[i]);
+        else if(i == 127)
+            snprintf(label, sizeof(label), "DEL");
+        else
+            snprintf(label, sizeof(label), "%c", i);
+        printf("  /* ASCII %3d: %-5s */ %s%s\n", i, label, entries[i] ? entries[i] : (i == 0 ? "KC_NO" : "0"),
+               i < 127 ? "," : "");
+    }
+    printf("};\n\n#endif // __layout_%s_h__\n", name);
+}
+
+int main(int argc, char **argv)
+{
+FILE        *f;
+char        line[256], name[64];
+const char  *base, *dot;
+
+    if(argc != 3){
+        fprintf(stderr, "usage: layoutgen keycode.h layout.txt > layout_name.h\n");
+        return 2;
+    }
+    if(readKeyNames(argv[1]) != 0)
+        return 1;
+    fileName = argv[2];
+    if(!(f = fopen(fileName, "r"))){
+        perror(fileName);
+        return 1;
+    }
+    while(fgets(line, sizeof(line), f)){
+        lineNumber++;
+        parseLine(line);
+    }
+    fclose(f);
+    if(errors)
+        return 1;
+
+    base = strrchr(fileName, '/') ? strrchr(fileName, '/') + 1 : fileName;
+    dot = strchr(base, '.');
+    snprintf(name, sizeof(name), "%.*s", dot ? (int)(dot - base) : (int)strlen(base), base);
+    writeHeader(name);
+    return 0;
+}
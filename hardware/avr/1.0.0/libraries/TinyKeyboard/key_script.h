@@ -0,0 +1,44 @@
+#ifndef __key_script_h__
+#define __key_script_h__
+
+// Key scripts: long sequences of text, keys and pauses kept in flash as a
+// few bytes each, which Keyboard.play() types from update() without
+// blocking the sketch. extras/keyscript compiles a script written as text
+// into such an array; it can also be written by hand:
+//
+//   const uint8_t openRun[] PROGMEM = {
+//     KS_MODIFIERS, LEFT_GUI, KS_TAP, KC_R, KS_MODIFIERS, 0,
+//     KS_DELAY_MS(500),
+//     KS_TEXT, 'c', 'm', 'd', '\n', 0,
+//     KS_END
+//   };
+//
+// Each instruction is an opcode, followed by its argument if it has one:
+//
+//   KS_TEXT ch... 0     types ASCII text with the layout's table, as print()
+//   KS_TAP key          presses and releases a key with the held modifiers
+//   KS_PRESS key        presses a key with the held modifiers; the next
+//                       report releases it
+//   KS_RELEASE          releases the key, keeping the modifiers
+//   KS_MODIFIERS mods   holds these modifiers (LEFT_CONTROL and so on) from
+//                       now on, 0 to let go of them; text brings its own
+//   KS_DELAY lo hi      waits until everything before has been sent, then
+//                       the given milliseconds (KS_DELAY_MS)
+//   KS_REPEAT n         runs the instructions up to KS_NEXT n times; repeats
+//                       don't nest
+//   KS_NEXT
+//   KS_END              the end of the script
+
+#define KS_END        0
+#define KS_TEXT       1
+#define KS_TAP        2
+#define KS_PRESS      3
+#define KS_RELEASE    4
+#define KS_MODIFIERS  5
+#define KS_DELAY      6
+#define KS_REPEAT     7
+#define KS_NEXT       8
+
+#define KS_DELAY_MS(ms) KS_DELAY, (uint8_t)(ms), (uint8_t)((ms) >> 8)
+
+#endif // __key_script_h__
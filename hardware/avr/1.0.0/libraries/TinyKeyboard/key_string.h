@@ -0,0 +1,51 @@
+#ifndef __key_string_h__
+#define __key_string_h__
+
+#include "ascii_keycode_table.h"
+
+// KSTR("text") translates a string literal with ascii_to_keycode while
+// compiling and puts the result in flash: a word per character in the
+// table's format (key code and modifiers), ending in 0. Keyboard.type()
+// sends it without looking anything up. A character the table has no key for stops
+// the build with an error naming KSTR_character_not_on_the_keyboard.
+//
+//   Keyboard.type(KSTR("Hello, World!\n"));
+//
+// Only C++11 is needed: the characters are expanded into a parameter pack by
+// KeyIndices, and each is looked up by a constexpr function.
+
+template <unsigned N> struct KeyString {
+  uint16_t codes[N];
+};
+
+template <unsigned... I> struct KeyIndices {};
+
+template <unsigned N, unsigned... I>
+struct MakeKeyIndices : MakeKeyIndices<N - 1, N - 1, I...> {};
+
+template <unsigned... I> struct MakeKeyIndices<0, I...> {
+  typedef KeyIndices<I...> type;
+};
+
+// deliberately not constexpr and never defined: calling it from keyStringCode()
+// makes KSTR fail to compile and names the reason
+uint16_t KSTR_character_not_on_the_keyboard();
+
+constexpr uint16_t keyStringCode(char ch) {
+  return (unsigned char)ch < sizeof(ascii_to_keycode) / sizeof(ascii_to_keycode[0]) && ascii_to_keycode[(unsigned char)ch]
+    ? ascii_to_keycode[(unsigned char)ch]
+    : KSTR_character_not_on_the_keyboard();
+}
+
+template <unsigned N, unsigned... I>
+constexpr KeyString<N> keyString(const char (&s)[N], KeyIndices<I...>) {
+  return KeyString<N>{{ keyStringCode(s[I])..., 0 }};
+}
+
+#define KSTR(s) ([]() {                                                         \
+  static constexpr KeyString<sizeof(s)> keys PROGMEM =                          \
+    keyString("" s, MakeKeyIndices<sizeof(s) - 1>::type());                     \
+  return &keys;                                                                 \
+}())
+
+#endif // __key_string_h__
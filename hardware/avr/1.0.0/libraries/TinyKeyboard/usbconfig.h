@@ -79,10 +79,22 @@ section at the end of this file).
  * (e.g. HID), but never want to send any data. This option saves a couple
  * of bytes in flash memory and the transmit buffers in RAM.
  */
+#ifndef USB_CFG_INTR_POLL_INTERVAL
 #define USB_CFG_INTR_POLL_INTERVAL      10
+#endif
 /* If you compile a version with endpoint 1 (interrupt-in), this is the poll
  * interval. The value is in milliseconds and must not be less than 10 ms for
- * low speed devices.
+ * low speed devices. Tools > USB poll interval sets it: Linux accepts 1 to 9
+ * ms as well, other hosts may poll no faster than every 8 ms.
+ */
+#define USB_CFG_INTR_QUEUE_SIZE         2
+/* Define this to the number of messages usbQueueInterrupt() can hold for the
+ * interrupt-in endpoint 1, or to 0 to leave the queue out. usbPoll() sends
+ * one message per poll interval. Each entry takes
+ * USB_CFG_INTR_QUEUE_REPORT_LEN + 1 bytes of RAM.
+ */
+#define USB_CFG_INTR_QUEUE_REPORT_LEN   8
+/* The longest message usbQueueInterrupt() accepts, up to 8 bytes.
  */
 #define USB_CFG_IS_SELF_POWERED         0
 /* Define this to 1 if the device has its own power supply. Set it to 0 if the
@@ -93,7 +105,7 @@ section at the end of this file).
  * The value is in milliamperes. [It will be divided by two since USB
  * communicates power requirements in units of 2 mA.]
  */
-#define USB_CFG_IMPLEMENT_FN_WRITE      0
+#define USB_CFG_IMPLEMENT_FN_WRITE      1
 /* Set this to 1 if you want usbFunctionWrite() to be called for control-out
  * transfers. Set it to 0 if you don't need it and want to save a couple of
  * bytes.
@@ -127,10 +139,15 @@ section at the end of this file).
  * proceed, do a return after doing your things. One possible application
  * (besides debugging) is to flash a status LED on each packet.
  */
-/* #define USB_RESET_HOOK(resetStarts)     if(!resetStarts){hadUsbReset();} */
+#ifndef __ASSEMBLER__
+extern unsigned char usbKeyboardProtocol;
+#endif
+#define USB_RESET_HOOK(resetStarts)     if(resetStarts){usbKeyboardProtocol = 1; usbConfiguration = 0;}
 /* This macro is a hook if you need to know when an USB RESET occurs. It has
  * one parameter which distinguishes between the start of RESET state and its
  * end.
+ * A reset leaves the device unconfigured, so TinyKeyboard keeps its reports
+ * until the host configures it again.
  */
 /* #define USB_SET_ADDRESS_HOOK()              hadAddressAssigned(); */
 /* This macro (if defined) is executed when a USB SET_ADDRESS request was
@@ -141,6 +158,13 @@ section at the end of this file).
  * counts SOF packets. This feature requires that the hardware interrupt is
  * connected to D- instead of D+.
  */
+#ifndef USB_COUNT_INTERRUPTS
+#define USB_COUNT_INTERRUPTS            0
+#endif
+/* define this macro to 1 if you need the global variable "usbIntrCount"
+ * which counts returns from the USB interrupt. The UsbLatency library needs
+ * it; it costs 5 cycles at the end of every interrupt.
+ */
 /* #ifdef __ASSEMBLER__
  * macro myAssemblerMacro
  *     in      YL, TCNT0
@@ -168,17 +192,33 @@ section at the end of this file).
  * usbFunctionWrite(). Use the global usbCurrentDataToken and a static variable
  * for each control- and out-endpoint to check for duplicate packets.
  */
-#define USB_CFG_HAVE_MEASURE_FRAME_LENGTH   0
+#define USB_CFG_HAVE_MEASURE_FRAME_LENGTH   USB_CFG_CALIBRATE_OSCILLATOR
 /* define this macro to 1 if you want the function usbMeasureFrameLength()
  * compiled in. This function can be used to calibrate the AVR's RC oscillator.
  */
+#ifndef USB_CFG_CALIBRATE_OSCILLATOR
+#define USB_CFG_CALIBRATE_OSCILLATOR        0
+#endif
+/* define this macro to 1 to tune OSCCAL against the USB frame length at the
+ * end of every USB reset and keep the result in EEPROM (see osccal.h). It
+ * needs usbMeasureFrameLength() and is only for devices clocked by the
+ * internal RC oscillator. Tools > USB oscillator calibration turns it on.
+ */
+#ifndef USB_CFG_VERIFY_RX_CRC
+#define USB_CFG_VERIFY_RX_CRC           0
+#endif
+/* define this macro to 1 to check the CRC of every data packet received and
+ * drop bad ones (see usbRxDiagnostics in usbdrv.h). It costs one usbCrc16()
+ * per packet in usbPoll().
+ */
+#ifndef USB_USE_FAST_CRC
 #define USB_USE_FAST_CRC                0
-/* The assembler module has two implementations for the CRC algorithm. One is
- * faster, the other is smaller. This CRC routine is only used for transmitted
- * messages where timing is not critical. The faster routine needs 31 cycles
- * per byte while the smaller one needs 61 to 69 cycles. The faster routine
- * may be worth the 32 bytes bigger code size if you transmit lots of data and
- * run the AVR close to its limit.
+#endif
+/* The assembler module has three implementations for the CRC algorithm, which
+ * is computed in usbPoll() for every data packet sent: 0 is the smallest and
+ * needs 61 to 69 cycles per byte, 1 needs 31 cycles for 32 bytes more code,
+ * and 2 needs 18 cycles with a 512 byte table in flash. Select one with
+ * Tools > USB CRC; usbcycles -c in usbdrv/extras/cycles compares them.
  */
 
 /* -------------------------- Device Description --------------------------- */
@@ -244,7 +284,18 @@ section at the end of this file).
  * HID class is 3, no subclass and protocol required (but may be useful!)
  * CDC class is 2, use subclass 2 and protocol 1 for ACM
  */
-#define USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH    35
+#ifndef TINY_KEYBOARD_COMPOSITE
+#define TINY_KEYBOARD_COMPOSITE     0
+#endif
+#if TINY_KEYBOARD_COMPOSITE
+#define USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH    132
+#else
+#define USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH    61
+#endif
+/* Tools > USB device sets TINY_KEYBOARD_COMPOSITE to 1 for a descriptor with
+ * a consumer control (media keys) and a mouse collection next to the
+ * keyboard, see TinyKeyboard.h.
+ */
 /* Define this to the length of the HID report descriptor, if you implement
  * an HID device. Otherwise don't define it or define it to 0.
  * If you use this define, you must add a PROGMEM character array named
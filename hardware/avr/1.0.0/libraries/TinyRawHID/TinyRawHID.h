@@ -0,0 +1,219 @@
+#ifndef __TinyRawHID_h__
+#define __TinyRawHID_h__
+
+#include <Arduino.h>
+#include <avr/wdt.h>
+
+extern "C" {
+  #include <usbdrv.h>
+}
+
+#include <TinyBootloader.h>
+
+
+/* A vendor defined HID device that exchanges 8 byte reports with the host in
+ * both directions, for commands that must arrive quickly:
+ *
+ *   interrupt-out endpoint 1  reports from the host, one per packet
+ *   interrupt-in endpoint 1   reports from the sketch, one per poll interval
+ *   SET_REPORT / GET_REPORT   the same reports through control transfers
+ *
+ * Reports from the host are handed to the onReceive() callback from update(),
+ * whichever way they came. The callback runs while the driver holds the
+ * receive buffer, so the next report is NAKed until it returns: keep it
+ * short, and don't call update() or delay() from it. send() queues a report
+ * for the interrupt-in endpoint and never waits; the report is also what
+ * GET_REPORT returns from then on.
+ *
+ * HID needs no driver on any host, and every OS lets programs write to the
+ * interrupt-out endpoint. Reports to it skip the setup and status stages of
+ * a control transfer, which saves a frame or more per command; the host polls
+ * the endpoint every USB_CFG_INTR_POLL_INTERVAL ms at most. extras/hidping
+ * measures the round trip both ways against the Echo example. The device
+ * uses obdev's shared ID for HID class devices, 16c0:05df, with the product
+ * name "TinyRawHID"; use micronucleus++ --app-id 16c0:05df to upload
+ * without replugging.
+ */
+#define TINY_RAW_HID_REPORT_SIZE 8
+
+#if USB_CFG_INTR_QUEUE_REPORT_LEN != TINY_RAW_HID_REPORT_SIZE
+#error "TinyRawHID needs USB_CFG_INTR_QUEUE_REPORT_LEN 8 in its usbconfig.h"
+#endif
+
+
+USB_PUBLIC usbMsgLen_t usbFunctionSetup(uchar data[8]);
+USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len);
+USB_PUBLIC void usbFunctionWriteOut(uchar *data, uchar len);
+
+const char usbHidReportDescriptor[USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH] PROGMEM = {
+  0x06, 0x00, 0xff, // USAGE_PAGE (Vendor Defined Page 1)
+  0x09, 0x01,       // USAGE (Vendor Usage 1)
+  0xa1, 0x01,       // COLLECTION (Application)
+  0x15, 0x00,       //   LOGICAL_MINIMUM (0)
+  0x26, 0xff, 0x00, //   LOGICAL_MAXIMUM (255)
+  0x75, 0x08,       //   REPORT_SIZE (8)
+  0x95, 0x08,       //   REPORT_COUNT (8)
+  0x09, 0x01,       //   USAGE (Vendor Usage 1)
+  0x81, 0x02,       //   INPUT (Data,Var,Abs)
+  0x09, 0x01,       //   USAGE (Vendor Usage 1)
+  0x91, 0x02,       //   OUTPUT (Data,Var,Abs)
+  0xc0              // END_COLLECTION
+};
+
+/* V-USB's configuration descriptor only has interrupt-in endpoints, so this
+ * one replaces it (USB_CFG_DESCR_PROPS_CONFIGURATION). The HID descriptor
+ * must stay at offset 18, where usbdrv.c answers GET_DESCRIPTOR(HID) from.
+ */
+PROGMEM const char usbDescriptorConfiguration[] = {
+  9,                          // sizeof(usbDescriptorConfiguration)
+  USBDESCR_CONFIG,
+  9 + 9 + 9 + 7 + 7, 0,       // total length including inlined descriptors
+  1,                          // number of interfaces
+  1,                          // index of this configuration
+  0,                          // configuration name string index
+  (char)(1 << 7),             // attributes: bus powered
+  USB_CFG_MAX_BUS_POWER / 2,  // max USB current in 2mA units
+
+  9,                          // sizeof(usbDescrInterface)
+  USBDESCR_INTERFACE,
+  0,                          // index of this interface
+  0,                          // alternate setting
+  2,                          // endpoints excluding 0
+  USB_CFG_INTERFACE_CLASS,
+  USB_CFG_INTERFACE_SUBCLASS,
+  USB_CFG_INTERFACE_PROTOCOL,
+  0,                          // string index for interface
+
+  9,                          // sizeof(usbDescrHID)
+  USBDESCR_HID,
+  0x01, 0x01,                 // HID version 1.01
+  0x00,                       // target country code
+  0x01,                       // number of class descriptors to follow
+  USBDESCR_HID_REPORT,
+  USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH, 0,
+
+  7,                          // sizeof(usbDescrEndpoint)
+  USBDESCR_ENDPOINT,
+  (char)0x81,                 // IN endpoint 1
+  0x03,                       // interrupt
+  TINY_RAW_HID_REPORT_SIZE, 0,
+  USB_CFG_INTR_POLL_INTERVAL,
+
+  7,                          // sizeof(usbDescrEndpoint)
+  USBDESCR_ENDPOINT,
+  0x01,                       // OUT endpoint 1
+  0x03,                       // interrupt
+  TINY_RAW_HID_REPORT_SIZE, 0,
+  USB_CFG_INTR_POLL_INTERVAL,
+};
+
+// data toggle of the last report on the interrupt-out endpoint, cleared by
+// USB_RESET_HOOK and USB_RX_USER_HOOK in usbconfig.h
+unsigned char usbRawHIDOutToken;
+
+class TinyRawHID {
+public:
+  typedef void (*Callback)(const uint8_t *report);
+
+  TinyRawHID() : usbState(USB_OFF) {
+    // a restart by the watchdog leaves it running; USB waits for begin()
+    wdt_disable();
+  }
+
+  // starts USB and returns at once; update() connects the device after the
+  // 250 ms off the bus that make the host enumerate it afresh. update()
+  // calls it if the sketch hasn't.
+  void begin() {
+    noInterrupts();
+    usbInit();
+    usbDeviceDisconnect();
+    interrupts();
+
+    usbSince = millis();
+    usbState = USB_DISCONNECTED;
+  }
+
+  void update() {
+    if (usbState != USB_CONNECTED) {
+      if (usbState == USB_OFF) begin();
+      if ((uint16_t)((uint16_t)millis() - usbSince) < 250) return;
+      usbDeviceConnect();
+      usbState = USB_CONNECTED;
+    }
+    usbPoll();
+  }
+
+  void delay(unsigned long ms) {
+    ms += millis();
+    while (millis() < ms) update();
+  }
+
+  // called with each report from the host, TINY_RAW_HID_REPORT_SIZE bytes
+  void onReceive(Callback callback) {
+    receiveCallback = callback;
+  }
+
+  // queues a report for the host; false if the queue is full
+  bool send(const uint8_t *report) {
+    memcpy(inputReport, report, sizeof(inputReport));
+    return usbQueueInterrupt(inputReport, sizeof(inputReport));
+  }
+
+  // true if send() has room for another report
+  bool ready() {
+    return !usbInterruptQueueIsFull();
+  }
+
+private:
+  Callback receiveCallback;
+  uchar inputReport[TINY_RAW_HID_REPORT_SIZE];
+  uchar outputReport[TINY_RAW_HID_REPORT_SIZE];
+  uint16_t usbSince;            // millis() when begin() let go of the bus
+  uint8_t usbState;
+  enum { USB_OFF, USB_DISCONNECTED, USB_CONNECTED };
+
+  // short packets are padded with zeros
+  void receive(const uchar *data, uchar len) {
+    if (len > sizeof(outputReport)) len = sizeof(outputReport);
+    memcpy(outputReport, data, len);
+    memset(outputReport + len, 0, sizeof(outputReport) - len);
+    if (receiveCallback) receiveCallback(outputReport);
+  }
+
+  friend USB_PUBLIC usbMsgLen_t usbFunctionSetup(uchar data[8]);
+  friend USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len);
+  friend USB_PUBLIC void usbFunctionWriteOut(uchar *data, uchar len);
+} RawHID;
+
+USB_PUBLIC usbMsgLen_t usbFunctionSetup(uchar data[8]) {
+  usbRequest_t *rq = (usbRequest_t *)data;
+
+  if ((rq->bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_CLASS) {
+    if (rq->bRequest == USBRQ_HID_GET_REPORT) {
+      usbMsgPtr = RawHID.inputReport;
+      return sizeof(RawHID.inputReport);
+    } else if (rq->bRequest == USBRQ_HID_SET_REPORT) {
+      return rq->wLength.word ? USB_NO_MSG : 0; // the report follows in usbFunctionWrite()
+    }
+  } else {
+    TinyBootloader::handleSetup(rq);
+  }
+
+  return 0;
+}
+
+// SET_REPORT: reports fit in one packet
+USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len) {
+  RawHID.receive(data, len);
+  return 1;
+}
+
+USB_PUBLIC void usbFunctionWriteOut(uchar *data, uchar len) {
+  // the host repeats a report whose ACK it missed, with the same toggle
+  if (usbCurrentDataToken == usbRawHIDOutToken) return;
+  usbRawHIDOutToken = usbCurrentDataToken;
+
+  RawHID.receive(data, len);
+}
+
+#endif // __TinyRawHID_h__
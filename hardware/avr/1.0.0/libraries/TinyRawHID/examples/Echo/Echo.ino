@@ -0,0 +1,17 @@
+// Sends every report from the host straight back. Measure the round trip
+// with extras/hidping: "hidping -n 1000".
+#include <TinyRawHID.h>
+
+void echo(const uint8_t *report) {
+  RawHID.send(report); // dropped if the host stopped reading
+}
+
+void setup() {
+  RawHID.onReceive(echo);
+  RawHID.begin();
+}
+
+
+void loop() {
+  RawHID.update();
+}
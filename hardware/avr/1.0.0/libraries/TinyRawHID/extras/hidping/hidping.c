@@ -0,0 +1,235 @@
+/* Name: hidping.c
+ * Project: TinyRawHID host utility
+ * Tabsize: 4
+ * License: GNU GPL v2 (see hardware/avr/1.0.0/libraries/usbdrv/License.txt), GNU GPL v3
+ *
+ *   hidping [-n count] [interrupt | control]
+ *
+ * Measures the round trip of a report through a sketch running the Echo
+ * example of TinyRawHID. See Makefile.
+ */
+
+/*
+General Description:
+The device is found by obdev's shared HID class ID 16c0:05df and the product
+name "TinyRawHID" (see usbdrv/USB-IDs-for-free.txt). The kernel's HID driver
+is detached for the duration. Each ping is an 8 byte report carrying a
+sequence number; it is timed from the start of the write until the echo
+with the same sequence number has been read:
+
+  interrupt   write to interrupt-out endpoint 1, read interrupt-in endpoint 1
+  control     SET_REPORT (output), then GET_REPORT (input) until it matches
+
+Without an argument both are measured, one after the other. The minimum,
+median, 99th percentile, maximum and mean round trip are printed for each.
+The interrupt endpoints are polled at most every bInterval ms (the host may
+round it down to a power of two), control transfers as soon as the bus is
+free, but each of them takes three transactions.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <usb.h>        /* libusb 0.1, as used by micronucleus++ */
+
+#define RAWHID_VENDOR_ID    0x16c0
+#define RAWHID_PRODUCT_ID   0x05df
+#define RAWHID_PRODUCT      "TinyRawHID"
+
+#define REPORT_SIZE         8       /* TINY_RAW_HID_REPORT_SIZE */
+#define EP_OUT              0x01
+#define EP_IN               0x81
+
+#define HID_GET_REPORT      0x01
+#define HID_SET_REPORT      0x09
+#define HID_REPORT_INPUT    0x0100
+#define HID_REPORT_OUTPUT   0x0200
+
+#define TIMEOUT_MS          1000
+
+static double now(void)
+{
+struct timeval  tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static usb_dev_handle *openDevice(void)
+{
+struct usb_bus      *bus;
+struct usb_device   *dev;
+char                product[64];
+
+    usb_init();
+    usb_find_busses();
+    usb_find_devices();
+    for(bus = usb_get_busses(); bus; bus = bus->next){
+        for(dev = bus->devices; dev; dev = dev->next){
+            usb_dev_handle  *handle;
+            if(dev->descriptor.idVendor != RAWHID_VENDOR_ID || dev->descriptor.idProduct != RAWHID_PRODUCT_ID)
+                continue;
+            if(!(handle = usb_open(dev)))
+                continue;
+            /* the ID is shared: only the product name tells it's ours */
+            if(usb_get_string_simple(handle, dev->descriptor.iProduct, product, sizeof(product)) > 0 &&
+               strcmp(product, RAWHID_PRODUCT) == 0)
+                return handle;
+            usb_close(handle);
+        }
+    }
+    return NULL;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: hidping [-n count] [interrupt | control]\n");
+    exit(2);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void makePing(char *report, unsigned seq)
+{
+    memset(report, 0, REPORT_SIZE);
+    report[0] = 'p';
+    report[1] = seq;
+    report[2] = seq >> 8;
+    report[3] = seq >> 16;
+}
+
+/* reads echoes until the one for this ping arrives; older ones are skipped */
+static int waitInterrupt(usb_dev_handle *handle, const char *ping)
+{
+char    echo[REPORT_SIZE];
+
+    for(;;){
+        int len = usb_interrupt_read(handle, EP_IN, echo, sizeof(echo), TIMEOUT_MS);
+        if(len < 0)
+            return -1;
+        if(len == REPORT_SIZE && memcmp(echo, ping, REPORT_SIZE) == 0)
+            return 0;
+    }
+}
+
+static int pingInterrupt(usb_dev_handle *handle, const char *ping)
+{
+    if(usb_interrupt_write(handle, EP_OUT, (char *)ping, REPORT_SIZE, TIMEOUT_MS) != REPORT_SIZE)
+        return -1;
+    return waitInterrupt(handle, ping);
+}
+
+static int pingControl(usb_dev_handle *handle, const char *ping)
+{
+char    echo[REPORT_SIZE];
+double  start = now();
+
+    if(usb_control_msg(handle, USB_ENDPOINT_OUT | USB_TYPE_CLASS | USB_RECIP_INTERFACE, HID_SET_REPORT,
+                       HID_REPORT_OUTPUT, 0, (char *)ping, REPORT_SIZE, TIMEOUT_MS) != REPORT_SIZE)
+        return -1;
+    /* the sketch answers on its next update(): ask until it has */
+    while(now() - start < TIMEOUT_MS / 1000.0){
+        if(usb_control_msg(handle, USB_ENDPOINT_IN | USB_TYPE_CLASS | USB_RECIP_INTERFACE, HID_GET_REPORT,
+                           HID_REPORT_INPUT, 0, echo, sizeof(echo), TIMEOUT_MS) != REPORT_SIZE)
+            return -1;
+        if(memcmp(echo, ping, REPORT_SIZE) == 0)
+            return 0;
+    }
+    return -1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int compareDouble(const void *a, const void *b)
+{
+double  x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static unsigned sequence;
+
+static int measure(usb_dev_handle *handle, const char *name, int (*ping)(usb_dev_handle *, const char *), int count)
+{
+double  *ms = malloc(count * sizeof(double)), sum = 0;
+char    report[REPORT_SIZE];
+int     i;
+
+    if(!ms){
+        perror("hidping");
+        return 1;
+    }
+    for(i = 0; i < count; i++){
+        double  start;
+        makePing(report, ++sequence);
+        start = now();
+        if(ping(handle, report) != 0){
+            fprintf(stderr, "hidping: %s ping %d failed: %s\n", name, i + 1, usb_strerror());
+            free(ms);
+            return 1;
+        }
+        ms[i] = (now() - start) * 1000;
+        sum += ms[i];
+    }
+    qsort(ms, count, sizeof(double), compareDouble);
+    printf("%-9s %d pings: min %.2f  median %.2f  p99 %.2f  max %.2f  mean %.2f ms\n", name, count,
+           ms[0], ms[count / 2], ms[(count * 99 - 1) / 100], ms[count - 1], sum / count);
+    free(ms);
+    return 0;
+}
+
+/* echoes the previous mode left in the sketch's queue */
+static void drain(usb_dev_handle *handle)
+{
+char    echo[REPORT_SIZE];
+
+    while(usb_interrupt_read(handle, EP_IN, echo, sizeof(echo), 50) > 0)
+        ;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+usb_dev_handle  *handle;
+const char      *mode = NULL;
+int             i, count = 200, result = 0;
+
+    for(i = 1; i < argc; i++){
+        if(i + 1 < argc && strcmp(argv[i], "-n") == 0){
+            count = atoi(argv[++i]);
+        }else if(!mode && (strcmp(argv[i], "interrupt") == 0 || strcmp(argv[i], "control") == 0)){
+            mode = argv[i];
+        }else{
+            usage();
+        }
+    }
+    if(count < 1){
+        fprintf(stderr, "hidping: count must be at least 1\n");
+        return 2;
+    }
+
+    if(!(handle = openDevice())){
+        fprintf(stderr, "hidping: no %s device (%04x:%04x) found\n", RAWHID_PRODUCT, RAWHID_VENDOR_ID, RAWHID_PRODUCT_ID);
+        return 1;
+    }
+#ifdef LIBUSB_HAS_DETACH_KERNEL_DRIVER_NP
+    usb_detach_kernel_driver_np(handle, 0);     /* fails harmlessly if none is attached */
+#endif
+    if(usb_claim_interface(handle, 0) != 0){
+        fprintf(stderr, "hidping: can't claim the interface: %s\n", usb_strerror());
+        usb_close(handle);
+        return 1;
+    }
+    drain(handle);
+    if(!mode || strcmp(mode, "interrupt") == 0)
+        result |= measure(handle, "interrupt", pingInterrupt, count);
+    if(!mode || strcmp(mode, "control") == 0){
+        drain(handle);
+        result |= measure(handle, "control", pingControl, count);
+    }
+    usb_release_interface(handle, 0);
+    usb_close(handle);
+    return result;
+}
@@ -0,0 +1,197 @@
+#ifndef __TinyUSBStream_h__
+#define __TinyUSBStream_h__
+
+#include <Arduino.h>
+#include <Stream.h>
+#include <avr/wdt.h>
+
+extern "C" {
+  #include <usbdrv.h>
+}
+
+#include <TinyBootloader.h>
+
+
+/* A vendor class USB device that moves bytes both ways through long control
+ * transfers, for pulling logs off a board much faster than typing them:
+ *
+ *   USBRQ_STREAM_READ   (IN)  up to wLength bytes the sketch has written;
+ *                             a short transfer means nothing more is waiting
+ *   USBRQ_STREAM_WRITE  (OUT) wLength bytes for the sketch to read
+ *   USBRQ_STREAM_STATUS (IN)  4 bytes: bytes waiting for the host and free
+ *                             space for host data, both little endian
+ *
+ * Data from the host is NAKed while the receive buffer can't take another
+ * packet (USB_CFG_HAVE_FLOWCONTROL), so the sketch must keep reading what it
+ * is sent. The bytes the sketch writes wait in the transmit buffer until the
+ * host reads them; write() polls USB while the buffer is full.
+ *
+ * The buffer sizes can be set before including this file and must be powers
+ * of two between 16 and 128 bytes. The device uses obdev's shared ID for
+ * vendor class devices, 16c0:05dc, with the product name "TinyUSBStream";
+ * extras/usbstream reads from it and reports the throughput. Use
+ * micronucleus++ --app-id 16c0:05dc to upload without replugging.
+ */
+#define USBRQ_STREAM_READ   0x01
+#define USBRQ_STREAM_WRITE  0x02
+#define USBRQ_STREAM_STATUS 0x03
+
+#ifndef TINY_USB_STREAM_TX_SIZE
+#define TINY_USB_STREAM_TX_SIZE 128
+#endif
+
+#ifndef TINY_USB_STREAM_RX_SIZE
+#define TINY_USB_STREAM_RX_SIZE 32
+#endif
+
+#if (TINY_USB_STREAM_TX_SIZE & (TINY_USB_STREAM_TX_SIZE - 1)) || TINY_USB_STREAM_TX_SIZE < 16 || TINY_USB_STREAM_TX_SIZE > 128
+#error "TINY_USB_STREAM_TX_SIZE must be a power of two from 16 to 128"
+#endif
+#if (TINY_USB_STREAM_RX_SIZE & (TINY_USB_STREAM_RX_SIZE - 1)) || TINY_USB_STREAM_RX_SIZE < 16 || TINY_USB_STREAM_RX_SIZE > 128
+#error "TINY_USB_STREAM_RX_SIZE must be a power of two from 16 to 128"
+#endif
+
+
+USB_PUBLIC usbMsgLen_t usbFunctionSetup(uchar data[8]);
+USB_PUBLIC uchar usbFunctionRead(uchar *data, uchar len);
+USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len);
+
+class TinyUSBStream : public Stream {
+public:
+  TinyUSBStream() : usbState(USB_OFF) {
+    // a restart by the watchdog leaves it running; USB waits for begin()
+    wdt_disable();
+  }
+
+  // starts USB and returns at once; update() connects the device after the
+  // 250 ms off the bus that make the host enumerate it afresh. update()
+  // calls it if the sketch hasn't.
+  void begin() {
+    noInterrupts();
+    usbInit();
+    usbDeviceDisconnect();
+    interrupts();
+
+    usbSince = millis();
+    usbState = USB_DISCONNECTED;
+  }
+
+  void update() {
+    if (usbState != USB_CONNECTED) {
+      if (usbState == USB_OFF) begin();
+      if ((uint16_t)((uint16_t)millis() - usbSince) < 250) return;
+      usbDeviceConnect();
+      usbState = USB_CONNECTED;
+    }
+    usbPoll();
+  }
+
+  void delay(unsigned long ms) {
+    ms += millis();
+    while (millis() < ms) update();
+  }
+
+  int available() {
+    return (uint8_t)(rxHead - rxTail);
+  }
+
+  int peek() {
+    if (!available()) return -1;
+    return rxBuffer[rxTail & (TINY_USB_STREAM_RX_SIZE - 1)];
+  }
+
+  int read() {
+    if (!available()) return -1;
+    uint8_t ch = rxBuffer[rxTail++ & (TINY_USB_STREAM_RX_SIZE - 1)];
+
+    // room for another packet: let the host send again
+    if (usbAllRequestsAreDisabled() && rxFree() >= 8) usbEnableAllRequests();
+    return ch;
+  }
+
+  int availableForWrite() {
+    return TINY_USB_STREAM_TX_SIZE - (uint8_t)(txHead - txTail);
+  }
+
+  size_t write(uint8_t ch) {
+    while (!availableForWrite()) update();
+    txBuffer[txHead++ & (TINY_USB_STREAM_TX_SIZE - 1)] = ch;
+    return 1;
+  }
+
+  // waits until the host has read everything written so far
+  void flush() {
+    while (txHead != txTail) update();
+  }
+
+  using Print::write;
+
+private:
+  uint8_t txBuffer[TINY_USB_STREAM_TX_SIZE];
+  uint8_t rxBuffer[TINY_USB_STREAM_RX_SIZE];
+  uint8_t txHead, txTail, rxHead, rxTail;
+  usbMsgLen_t writeRemaining;
+  uchar statusReply[4];
+  uint16_t usbSince;            // millis() when begin() let go of the bus
+  uint8_t usbState;
+  enum { USB_OFF, USB_DISCONNECTED, USB_CONNECTED };
+
+  uint8_t rxFree() {
+    return TINY_USB_STREAM_RX_SIZE - (uint8_t)(rxHead - rxTail);
+  }
+
+  friend USB_PUBLIC usbMsgLen_t usbFunctionSetup(uchar data[8]);
+  friend USB_PUBLIC uchar usbFunctionRead(uchar *data, uchar len);
+  friend USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len);
+} UsbStream;
+
+USB_PUBLIC usbMsgLen_t usbFunctionSetup(uchar data[8]) {
+  usbRequest_t *rq = (usbRequest_t *)data;
+
+  if ((rq->bmRequestType & USBRQ_TYPE_MASK) != USBRQ_TYPE_VENDOR) return 0;
+
+  if (rq->bRequest == USBRQ_STREAM_READ) {
+    return USB_NO_MSG; // usbFunctionRead() until the buffer runs dry
+  } else if (rq->bRequest == USBRQ_STREAM_WRITE) {
+    UsbStream.writeRemaining = rq->wLength.word;
+    return UsbStream.writeRemaining ? USB_NO_MSG : 0;
+  } else if (rq->bRequest == USBRQ_STREAM_STATUS) {
+    uint8_t waiting = UsbStream.txHead - UsbStream.txTail;
+    uint8_t space = UsbStream.rxFree();
+
+    UsbStream.statusReply[0] = waiting;
+    UsbStream.statusReply[1] = 0;
+    UsbStream.statusReply[2] = space;
+    UsbStream.statusReply[3] = 0;
+    usbMsgPtr = UsbStream.statusReply;
+    return sizeof(UsbStream.statusReply);
+  }
+
+  TinyBootloader::handleSetup(rq);
+  return 0;
+}
+
+USB_PUBLIC uchar usbFunctionRead(uchar *data, uchar len) {
+  uchar n = 0;
+
+  while (n < len && UsbStream.txHead != UsbStream.txTail) {
+    data[n++] = UsbStream.txBuffer[UsbStream.txTail++ & (TINY_USB_STREAM_TX_SIZE - 1)];
+  }
+
+  return n;
+}
+
+USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len) {
+  // flow control below guarantees room for a whole packet
+  for (uchar i = 0; i < len; i++) {
+    UsbStream.rxBuffer[UsbStream.rxHead++ & (TINY_USB_STREAM_RX_SIZE - 1)] = data[i];
+  }
+
+  if (UsbStream.rxFree() < 8) usbDisableAllRequests();
+
+  if (len >= UsbStream.writeRemaining) return 1;
+  UsbStream.writeRemaining -= len;
+  return 0;
+}
+
+#endif // __TinyUSBStream_h__
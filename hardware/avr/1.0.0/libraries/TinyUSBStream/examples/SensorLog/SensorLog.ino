@@ -0,0 +1,24 @@
+// Logs a timestamped analog reading every 10 ms. Collect the log on the host
+// with "usbstream read -o log.txt"; readings taken while the buffer is full
+// are dropped rather than holding up the log.
+#include <TinyUSBStream.h>
+
+unsigned long lastSample;
+
+void setup() {
+  UsbStream.begin();
+}
+
+
+void loop() {
+  UsbStream.update();
+
+  if (millis() - lastSample < 10) return;
+  lastSample += 10;
+
+  // "4294967295 1023\r\n" is the longest line
+  if (UsbStream.availableForWrite() < 18) return;
+  UsbStream.print(lastSample);
+  UsbStream.print(' ');
+  UsbStream.println(analogRead(A1));
+}
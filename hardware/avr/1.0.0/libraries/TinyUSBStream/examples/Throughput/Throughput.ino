@@ -0,0 +1,17 @@
+// Streams a counting pattern to the host and throws away whatever the host
+// sends. Measure with extras/usbstream: "usbstream read -c -t 10" and
+// "usbstream write -t 10".
+#include <TinyUSBStream.h>
+
+uint8_t next;
+
+void setup() {
+  UsbStream.begin();
+}
+
+
+void loop() {
+  while (UsbStream.availableForWrite()) UsbStream.write(next++);
+  while (UsbStream.available()) UsbStream.read();
+  UsbStream.update();
+}
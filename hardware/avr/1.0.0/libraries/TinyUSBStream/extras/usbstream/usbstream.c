@@ -0,0 +1,271 @@
+/* Name: usbstream.c
+ * Project: TinyUSBStream host utility
+ * Tabsize: 4
+ * License: GNU GPL v2 (see hardware/avr/1.0.0/libraries/usbdrv/License.txt), GNU GPL v3
+ *
+ *   usbstream read  [-n bytes] [-t seconds] [-s size] [-o file] [-c]
+ *   usbstream write [-n bytes] [-t seconds] [-s size] [-i file]
+ *   usbstream status
+ *
+ * Moves data to or from a sketch using TinyUSBStream and reports the
+ * sustained throughput. See Makefile.
+ */
+
+/*
+General Description:
+The device is found by obdev's shared vendor class ID 16c0:05dc and the
+product name "TinyUSBStream" (see usbdrv/USB-IDs-for-free.txt). Data moves
+in vendor control transfers of up to -s bytes (default 1024):
+
+  read    repeats USBRQ_STREAM_READ and writes what arrives to stdout or -o.
+          A short transfer means the sketch had nothing more buffered; the
+          next one is sent straight away. With -c the data must be the
+          counting pattern of the Throughput example (0, 1, ... 255, 0, ...)
+          and every byte out of sequence is counted as an error.
+  write   sends the counting pattern, or the contents of -i, with
+          USBRQ_STREAM_WRITE. The device NAKs while its buffer is full, so
+          the rate is what the sketch consumes.
+  status  prints the device's buffer levels.
+
+Both transfers stop after -n bytes or -t seconds, whichever comes first, and
+print the rate once a second and the sustained rate at the end on stderr.
+Low speed control transfers carry 8 bytes per packet, so expect a few
+kilobytes per second at most.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <usb.h>        /* libusb 0.1, as used by micronucleus++ */
+
+#define STREAM_VENDOR_ID    0x16c0
+#define STREAM_PRODUCT_ID   0x05dc
+#define STREAM_PRODUCT      "TinyUSBStream"
+
+/* must match TinyUSBStream.h */
+#define USBRQ_STREAM_READ   0x01
+#define USBRQ_STREAM_WRITE  0x02
+#define USBRQ_STREAM_STATUS 0x03
+
+#define TIMEOUT_MS          5000
+
+static double now(void)
+{
+struct timeval  tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static usb_dev_handle *openDevice(void)
+{
+struct usb_bus      *bus;
+struct usb_device   *dev;
+char                product[64];
+
+    usb_init();
+    usb_find_busses();
+    usb_find_devices();
+    for(bus = usb_get_busses(); bus; bus = bus->next){
+        for(dev = bus->devices; dev; dev = dev->next){
+            usb_dev_handle  *handle;
+            if(dev->descriptor.idVendor != STREAM_VENDOR_ID || dev->descriptor.idProduct != STREAM_PRODUCT_ID)
+                continue;
+            if(!(handle = usb_open(dev)))
+                continue;
+            /* the ID is shared: only the product name tells it's ours */
+            if(usb_get_string_simple(handle, dev->descriptor.iProduct, product, sizeof(product)) > 0 &&
+               strcmp(product, STREAM_PRODUCT) == 0)
+                return handle;
+            usb_close(handle);
+        }
+    }
+    return NULL;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: usbstream read  [-n bytes] [-t seconds] [-s size] [-o file] [-c]\n"
+                    "       usbstream write [-n bytes] [-t seconds] [-s size] [-i file]\n"
+                    "       usbstream status\n");
+    exit(2);
+}
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct{
+    double          start, lastReport;
+    unsigned long   bytes, lastBytes, transfers, errors;
+}rate_t;
+
+static void rateUpdate(rate_t *r, int final)
+{
+double  t = now();
+
+    if(!final && t - r->lastReport < 1)
+        return;
+    if(final){
+        double  elapsed = t - r->start;
+        fprintf(stderr, "%lu bytes in %.2f s, %lu transfers: %.0f bytes/s sustained", r->bytes,
+                elapsed, r->transfers, elapsed > 0 ? r->bytes / elapsed : 0);
+    }else{
+        fprintf(stderr, "%8lu bytes  %6.0f bytes/s", r->bytes, (r->bytes - r->lastBytes) / (t - r->lastReport));
+    }
+    if(r->errors)
+        fprintf(stderr, ", %lu bytes out of sequence", r->errors);
+    fprintf(stderr, "\n");
+    r->lastReport = t;
+    r->lastBytes = r->bytes;
+}
+
+static int streamRead(usb_dev_handle *handle, unsigned long limit, double seconds, int size, FILE *out, int check)
+{
+char            buffer[65535];
+unsigned char   expected = 0;
+int             first = 1;
+rate_t          r;
+
+    memset(&r, 0, sizeof(r));
+    r.start = r.lastReport = now();
+    while(r.bytes < limit && now() - r.start < seconds){
+        int i, len, want = size;
+        if(limit - r.bytes < (unsigned long)want)
+            want = limit - r.bytes;
+        len = usb_control_msg(handle, USB_ENDPOINT_IN | USB_TYPE_VENDOR | USB_RECIP_DEVICE,
+                              USBRQ_STREAM_READ, 0, 0, buffer, want, TIMEOUT_MS);
+        if(len < 0){
+            fprintf(stderr, "usbstream: read failed: %s\n", usb_strerror());
+            return 1;
+        }
+        r.transfers++;
+        if(check){
+            for(i = 0; i < len; i++){
+                unsigned char c = buffer[i];
+                if(!first && c != expected)
+                    r.errors++;
+                expected = c + 1;
+                first = 0;
+            }
+        }
+        if(out && len > 0 && fwrite(buffer, 1, len, out) != (size_t)len){
+            perror("usbstream: output");
+            return 1;
+        }
+        r.bytes += len;
+        rateUpdate(&r, 0);
+    }
+    rateUpdate(&r, 1);
+    return r.errors != 0;
+}
+
+static int streamWrite(usb_dev_handle *handle, unsigned long limit, double seconds, int size, FILE *in)
+{
+char            buffer[65535];
+unsigned char   next = 0;
+rate_t          r;
+
+    memset(&r, 0, sizeof(r));
+    r.start = r.lastReport = now();
+    while(r.bytes < limit && now() - r.start < seconds){
+        int i, len = size;
+        if(limit - r.bytes < (unsigned long)len)
+            len = limit - r.bytes;
+        if(in){
+            len = fread(buffer, 1, len, in);
+            if(len == 0)
+                break;
+        }else{
+            for(i = 0; i < len; i++)
+                buffer[i] = next++;
+        }
+        if(usb_control_msg(handle, USB_ENDPOINT_OUT | USB_TYPE_VENDOR | USB_RECIP_DEVICE,
+                           USBRQ_STREAM_WRITE, 0, 0, buffer, len, TIMEOUT_MS) != len){
+            fprintf(stderr, "usbstream: write failed: %s\n", usb_strerror());
+            return 1;
+        }
+        r.transfers++;
+        r.bytes += len;
+        rateUpdate(&r, 0);
+    }
+    rateUpdate(&r, 1);
+    return 0;
+}
+
+static int streamStatus(usb_dev_handle *handle)
+{
+unsigned char   status[4];
+
+    if(usb_control_msg(handle, USB_ENDPOINT_IN | USB_TYPE_VENDOR | USB_RECIP_DEVICE,
+                       USBRQ_STREAM_STATUS, 0, 0, (char *)status, sizeof(status), TIMEOUT_MS) != sizeof(status)){
+        fprintf(stderr, "usbstream: status failed: %s\n", usb_strerror());
+        return 1;
+    }
+    printf("%u bytes waiting for the host, room for %u bytes from the host\n",
+           status[0] | status[1] << 8, status[2] | status[3] << 8);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+usb_dev_handle  *handle;
+unsigned long   limit = ~0UL;
+double          seconds = 1e9;
+int             i, size = 1024, check = 0, result;
+const char      *mode, *inName = NULL, *outName = NULL;
+FILE            *in = NULL, *out = stdout;
+
+    if(argc < 2)
+        usage();
+    mode = argv[1];
+    for(i = 2; i < argc; i++){
+        if(strcmp(argv[i], "-c") == 0){
+            check = 1;
+        }else if(i + 1 < argc && strcmp(argv[i], "-n") == 0){
+            limit = strtoul(argv[++i], NULL, 0);
+        }else if(i + 1 < argc && strcmp(argv[i], "-t") == 0){
+            seconds = atof(argv[++i]);
+        }else if(i + 1 < argc && strcmp(argv[i], "-s") == 0){
+            size = atoi(argv[++i]);
+        }else if(i + 1 < argc && strcmp(argv[i], "-o") == 0){
+            outName = argv[++i];
+        }else if(i + 1 < argc && strcmp(argv[i], "-i") == 0){
+            inName = argv[++i];
+        }else{
+            usage();
+        }
+    }
+    if(size < 1 || size > 65535){
+        fprintf(stderr, "usbstream: transfer size must be 1 to 65535 bytes\n");
+        return 2;
+    }
+    if(outName && !(out = fopen(outName, "wb"))){
+        perror(outName);
+        return 1;
+    }
+    if(inName && !(in = fopen(inName, "rb"))){
+        perror(inName);
+        return 1;
+    }
+    if(check && !outName)
+        out = NULL;     /* checking the pattern: nothing worth printing */
+
+    if(!(handle = openDevice())){
+        fprintf(stderr, "usbstream: no %s device (%04x:%04x) found\n", STREAM_PRODUCT, STREAM_VENDOR_ID, STREAM_PRODUCT_ID);
+        return 1;
+    }
+    if(strcmp(mode, "read") == 0)
+        result = streamRead(handle, limit, seconds, size, out, check);
+    else if(strcmp(mode, "write") == 0)
+        result = streamWrite(handle, limit, seconds, size, in);
+    else if(strcmp(mode, "status") == 0)
+        result = streamStatus(handle);
+    else
+        usage();
+    usb_close(handle);
+    if(out && out != stdout)
+        fclose(out);
+    return result;
+}
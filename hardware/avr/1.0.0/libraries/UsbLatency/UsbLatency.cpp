@@ -0,0 +1,14 @@
+#include "UsbLatency.h"
+
+namespace UsbLatency {
+  const char millisName[] PROGMEM = "TIMER0_OVF_vect (millis)";
+  const char otherName[] PROGMEM = "other ISR or cli()";
+
+  const char *volatile handler;
+  volatile uint8_t handlerCount;
+  volatile uint8_t noBlockCount;
+
+  uint16_t worst;
+  const char *worstName;
+  uint16_t iteration = 0xffff;
+}
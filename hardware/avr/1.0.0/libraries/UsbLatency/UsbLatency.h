@@ -0,0 +1,268 @@
+#ifndef __UsbLatency_h__
+#define __UsbLatency_h__
+
+#include <Arduino.h>
+#include <Print.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+extern "C" {
+  #include <usbdrv.h>
+}
+
+/* Measures how long the sketch's interrupt handlers keep the USB interrupt
+ * waiting. V-USB must enter its interrupt routine within the sync pattern of
+ * every packet, so any handler that runs with interrupts disabled for longer
+ * than USB_LATENCY_BUDGET cycles makes the device lose packets.
+ *
+ * UsbLatency::measure() spins on a cycle counter for the given time. Every
+ * interrupt shows up as a gap between two readings; the gap minus the length
+ * of one loop iteration is the time the interrupt kept everything else out.
+ * Each gap is put down to the handler that ran in it:
+ *
+ *   - handlers defined with USB_LATENCY_ISR() by their vector name,
+ *   - the core's millis() timer by the change of timer0_overflow_count,
+ *   - anything else (an unwrapped ISR, a long cli() in a library) as "other".
+ *
+ * Gaps in which the USB interrupt ran are left out: it is the victim, not the
+ * culprit. Telling it apart needs usbIntrCount, so select
+ * Tools > USB latency probe > On, which builds usbdrv with
+ * USB_COUNT_INTERRUPTS and adds 5 cycles to the end of every USB interrupt.
+ * Handlers declared ISR_NOBLOCK let the USB interrupt in; wrap them with
+ * USB_LATENCY_ISR_NOBLOCK() so that their gaps are left out as well.
+ *
+ * The probe takes timer1 over at the CPU clock, so analogWrite() on its pins
+ * stops working. On the ATtiny25/45/85 timer1 has only 8 bits; the core's
+ * timer0 (prescaler 64) resolves the wraps, which limits gaps to about 16000
+ * cycles. The probe itself disables interrupts for 2 cycles per reading.
+ * Run the sketch's normal interrupt load while measuring, then print() the
+ * result, for example with TinyKeyboard.
+ */
+
+#if !USB_COUNT_INTERRUPTS
+  #error "UsbLatency needs usbIntrCount: select Tools > USB latency probe > On"
+#endif
+
+/* Cycles another interrupt may keep the USB interrupt waiting: the interrupt
+ * latency each usbdrvasm*.inc module allows (extras/cycles reports it) minus
+ * the interrupt response and the longest instruction.
+ */
+#ifndef USB_LATENCY_BUDGET
+  #if USB_CFG_CLOCK_KHZ == 12000
+    #define USB_LATENCY_BUDGET 25
+  #elif USB_CFG_CLOCK_KHZ == 12800
+    #define USB_LATENCY_BUDGET 39
+  #elif USB_CFG_CLOCK_KHZ == 15000
+    #define USB_LATENCY_BUDGET 48
+  #elif USB_CFG_CLOCK_KHZ == 16000
+    #define USB_LATENCY_BUDGET 50
+  #elif USB_CFG_CLOCK_KHZ == 16500
+    #define USB_LATENCY_BUDGET 52
+  #elif USB_CFG_CLOCK_KHZ == 18000
+    #define USB_LATENCY_BUDGET 58
+  #elif USB_CFG_CLOCK_KHZ == 20000
+    #define USB_LATENCY_BUDGET 66
+  #else
+    #error "No latency budget known for this clock, define USB_LATENCY_BUDGET"
+  #endif
+#endif
+
+/* Defines an interrupt handler that UsbLatency can name, e.g.
+ *
+ *   USB_LATENCY_ISR(INT0_vect) {
+ *     presses++;
+ *   }
+ *
+ * Extra arguments are passed on to ISR(). The body is inlined, so the
+ * handler costs only two stores more than a plain ISR().
+ */
+#define USB_LATENCY_ISR(vector, ...)                                     \
+  static inline void vector##_latencyBody(void) __attribute__((always_inline)); \
+  ISR(vector, ##__VA_ARGS__) {                                           \
+    static const char name[] PROGMEM = #vector;                          \
+    UsbLatency::handler = name;                                          \
+    UsbLatency::handlerCount++;                                          \
+    vector##_latencyBody();                                              \
+  }                                                                      \
+  static inline void vector##_latencyBody(void)
+
+#define USB_LATENCY_ISR_NOBLOCK(vector)                                  \
+  static inline void vector##_latencyBody(void) __attribute__((always_inline)); \
+  ISR(vector, ISR_NOBLOCK) {                                             \
+    UsbLatency::noBlockCount++;                                          \
+    vector##_latencyBody();                                              \
+  }                                                                      \
+  static inline void vector##_latencyBody(void)
+
+extern volatile unsigned long timer0_overflow_count;
+
+// defined once in UsbLatency.cpp, so handlers in any file of the sketch count
+namespace UsbLatency {
+  extern const char millisName[] PROGMEM;
+  extern const char otherName[] PROGMEM;
+
+  // written by the handlers
+  extern const char *volatile handler;
+  extern volatile uint8_t handlerCount;
+  extern volatile uint8_t noBlockCount;
+
+  extern uint16_t worst;
+  extern const char *worstName;
+  extern uint16_t iteration;
+
+  struct Counts {
+    uint8_t usb, millis, handlers, noBlock;
+
+    bool operator==(const Counts &other) const {
+      return usb == other.usb && millis == other.millis &&
+             handlers == other.handlers && noBlock == other.noBlock;
+    }
+  };
+
+  inline Counts counts() {
+    Counts c;
+    c.usb = usbIntrCount;
+    c.millis = *(volatile uint8_t *)&timer0_overflow_count;
+    c.handlers = handlerCount;
+    c.noBlock = noBlockCount;
+    return c;
+  }
+
+  inline void begin() {
+#if defined(TCCR1)
+    GTCCR &= ~_BV(PWM1B);
+    TCCR1 = _BV(CS10);
+#else
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10);
+#endif
+  }
+
+  inline void reset() {
+    worst = 0;
+    worstName = NULL;
+  }
+
+#if defined(TCCR1)
+  typedef struct { uint8_t coarse, fine; } Time;
+
+  inline Time now() {
+    Time t;
+    uint8_t sreg = SREG;
+    cli();
+    t.coarse = TCNT0;
+    t.fine = TCNT1;
+    SREG = sreg;
+    return t;
+  }
+
+  // timer1 gives the cycles modulo 256, timer0 the gap to within 64 cycles
+  inline uint16_t cycles(Time from, Time to) {
+    uint16_t approx = (uint8_t)(to.coarse - from.coarse) * 64;
+    uint8_t fine = to.fine - from.fine;
+    return approx + (int8_t)(fine - (uint8_t)approx);
+  }
+#else
+  typedef uint16_t Time;
+
+  inline Time now() {
+    uint8_t sreg = SREG;
+    cli();
+    Time t = TCNT1;
+    SREG = sreg;
+    return t;
+  }
+
+  inline uint16_t cycles(Time from, Time to) {
+    return to - from;
+  }
+#endif
+
+  inline void record(uint16_t blocked, const char *name) {
+    if (blocked > worst) {
+      worst = blocked;
+      worstName = name;
+    }
+  }
+
+  // takes a reading with no interrupt between it and the counters
+  inline void sample(Time &t, Counts &c) {
+    for (;;) {
+      c = counts();
+      t = now();
+      if (counts() == c) return;
+    }
+  }
+
+  inline void measure(uint16_t ms) {
+    while (ms--) {
+      usbPoll();
+
+      Time last, t;
+      Counts before, after;
+      uint16_t elapsed = 0;
+
+      sample(last, before);
+      while (elapsed < F_CPU / 1000) {
+        sample(t, after);
+        uint16_t gap = cycles(last, t);
+        elapsed += gap;
+        last = t;
+
+        if (gap < iteration) iteration = gap;
+
+        if (after == before) {
+          // no handler ran, but the loop was held up: a cli() section
+          if (gap - iteration > 8) record(gap - iteration, otherName);
+          continue;
+        }
+
+        if (after.usb != before.usb || after.noBlock != before.noBlock) {
+          // the USB interrupt ran, or a handler that lets it in
+        } else if (after.handlers != before.handlers) {
+          record(gap - iteration, handler);
+        } else {
+          record(gap - iteration, after.millis != before.millis ? millisName : otherName);
+        }
+
+        // the bookkeeping above is not part of the next gap
+        sample(last, before);
+      }
+    }
+  }
+
+  // longest time an interrupt other than USB kept interrupts disabled
+  inline uint16_t worstCycles() {
+    return worst;
+  }
+
+  // name of the handler responsible, in PROGMEM; NULL if none was seen
+  inline const char *worstHandler() {
+    return worstName;
+  }
+
+  inline uint16_t budget() {
+    return USB_LATENCY_BUDGET;
+  }
+
+  inline bool withinBudget() {
+    return worst <= USB_LATENCY_BUDGET;
+  }
+
+  // e.g. "USB latency 61 of 52 cycles, TIMER0_OVF_vect (millis) TOO LONG"
+  inline void print(Print &out) {
+    out.print(F("USB latency "));
+    out.print(worst);
+    out.print(F(" of "));
+    out.print(budget());
+    out.print(F(" cycles"));
+    if (worstName) {
+      out.print(F(", "));
+      out.print((const __FlashStringHelper *)worstName);
+    }
+    if (!withinBudget()) out.print(F(" TOO LONG"));
+    out.println();
+  }
+}
+
+#endif // __UsbLatency_h__
@@ -0,0 +1,27 @@
+// Select Tools > USB latency probe > On to build this sketch.
+#include <TinyKeyboard.h>
+#include <UsbLatency.h>
+
+volatile unsigned presses;
+
+// a button from PB2 to ground
+USB_LATENCY_ISR(INT0_vect) {
+  presses++;
+}
+
+void setup() {
+  Keyboard.begin();
+  PORTB |= _BV(PB2);
+  MCUCR |= _BV(ISC01);
+  GIMSK |= _BV(INT0);
+
+  UsbLatency::begin();
+}
+
+
+void loop() {
+  UsbLatency::reset();
+  UsbLatency::measure(1000);
+  UsbLatency::print(Keyboard);
+  Keyboard.delay(5000);
+}
@@ -0,0 +1,1677 @@
+/* Name: usbcycles.cpp
+ * Project: V-USB cycle budget checker
+ * Tabsize: 4
+ * License: GNU GPL v2 (see ../../License.txt), GNU GPL v3
+ *
+ *   usbcycles [-v] [-c] [-DNAME[=value]...] path/to/usbdrvasm.S
+ *
+ * Checks the timing of the receiver and transmitter in the usbdrvasm*.inc
+ * modules against the low speed bit time. Exits with status 1 if a module
+ * breaks its budget. See Makefile and ../../Readme.txt.
+ */
+
+/*
+General Description:
+The modules are written against a cycle budget that only exists in their
+comments. This checker computes it from the code instead: it reads
+usbdrvasm.S for the clock that selects each module, reads the module with
+asmcommon.inc, and follows every path through the code with the classic
+AVR core instruction timing. Branches on loop counters are decided from the
+values loaded into them; branches on bus data go both ways, and each way
+remembers what it implies, which keeps the walk off paths no data can take.
+
+  - receiver: from the first data sample after sync, every read of D- is a
+    whole number of bit times after the previous one. The accumulated error
+    against the ideal bit clock must stay within a quarter bit on every path
+    (one cycle more for the PLL modules), for the first four bytes of the
+    packet. Reads marked "phase" are not data samples. A path ends when it
+    has seen SE0.
+  - transmitter: every "out USBOUT" from usbSendAndReti to the end of packet
+    falls on a bit boundary of the ideal bit clock, within one cycle plus the
+    1.5% data rate tolerance of low speed.
+  - interrupt entry: the declared max interrupt latency plus the cycles from
+    the vector to waitForK fit into the sync pattern.
+  - clock: the header's cycles per bit match the clock usbdrvasm.S selects
+    the module for, which must lie within the module's frequency range.
+  - macros: POP_STANDARD and friends take the cycles their header comment
+    claims.
+
+The "[n]" cycle annotations in the comments are not used: many of them count
+from different reference points and several are stale.
+
+With -c the modules are not checked. Instead the cycles of the three
+versions of usbCrc16() are printed (USB_USE_FAST_CRC 0, 1 and 2), per byte
+and for a full 8 byte packet, fewest and most over all data.
+
+Conditional code (#if) is checked for every combination of the USB_* options
+the module tests, unless the option is fixed with -D. USBMINUS and USBPLUS
+default to 3 and 4; the pins don't change the timing.
+*/
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+static bool verbose;
+static int  failures;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- source model ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+struct Line{
+    string          file;
+    int             number;
+    vector<string>  labels;
+    string          mnemonic;   // lower case, empty for label-only lines
+    vector<string>  operands;
+    vector<string>  rawOperands;    // before #define substitution
+    string          comment;
+};
+
+struct Macro{
+    vector<Line>    body;
+    int             declaredCycles; // -1 if the header has no "; N cycles"
+    Line            header;
+};
+
+typedef map<string, long>   Defines;
+typedef map<string, string> Aliases;
+
+struct Source{
+    vector<Line>        lines;
+    map<string, Macro>  macros;
+    string              module;     // file name of the module itself
+    set<string>         options;    // USB_* tested by #if in the module
+    Aliases             aliases;    // "#define ifioclr sbis", "#define fix x2"
+};
+
+static string trim(const string &s)
+{
+    size_t  b = s.find_first_not_of(" \t\r"), e = s.find_last_not_of(" \t\r");
+    return b == string::npos ? string() : s.substr(b, e - b + 1);
+}
+
+static string lower(string s)
+{
+    for(size_t i = 0; i < s.size(); i++)
+        s[i] = tolower(s[i]);
+    return s;
+}
+
+static bool isIdentifier(const string &s)
+{
+    if(s.empty() || !(isalpha((unsigned char)s[0]) || s[0] == '_'))
+        return false;
+    for(size_t i = 1; i < s.size(); i++){
+        if(!isalnum((unsigned char)s[i]) && s[i] != '_')
+            return false;
+    }
+    return true;
+}
+
+static string directory(const string &path)
+{
+    size_t  slash = path.find_last_of("/\\");
+    return slash == string::npos ? string() : path.substr(0, slash + 1);
+}
+
+static string basename(const string &path)
+{
+    return path.substr(directory(path).size());
+}
+
+static void fail(const Line &line, const string &message)
+{
+    printf("%s:%d: %s\n", line.file.c_str(), line.number, message.c_str());
+    failures++;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- preprocessor ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+class Expression{
+public:
+    Expression(const string &text, const Defines &defines) : s(text), p(0), defines(defines), unknown(false) {}
+    long evaluate() { return orExpr(); }
+    bool known() const { return !unknown; }    // no undefined identifiers
+
+private:
+    const string    &s;
+    size_t          p;
+    const Defines   &defines;
+    bool            unknown;
+
+    void skip() { while(p < s.size() && isspace((unsigned char)s[p])) p++; }
+    bool accept(const char *op)
+    {
+        size_t  n = strlen(op);
+
+        skip();
+        if(s.compare(p, n, op) != 0)
+            return false;
+        // don't take "<" from "<=", "!" from "!=" or "&" from "&&"
+        if(n == 1 && p + 1 < s.size() && s[p + 1] == '=' && strchr("<>!=", op[0]))
+            return false;
+        if(n == 1 && p + 1 < s.size() && strchr("&|<>", op[0]) && s[p + 1] == op[0])
+            return false;
+        p += n;
+        return true;
+    }
+    string identifier()
+    {
+        size_t  start;
+
+        skip();
+        start = p;
+        while(p < s.size() && (isalnum((unsigned char)s[p]) || s[p] == '_'))
+            p++;
+        return s.substr(start, p - start);
+    }
+    long orExpr()   { long v = andExpr(); while(accept("||")) { long r = andExpr(); v = v || r; } return v; }
+    long andExpr()  { long v = cmpExpr(); while(accept("&&")) { long r = cmpExpr(); v = v && r; } return v; }
+    long cmpExpr()
+    {
+        long    v = shiftExpr();
+        for(;;){
+            if(accept("==")) v = v == shiftExpr();
+            else if(accept("!=")) v = v != shiftExpr();
+            else if(accept("<=")) v = v <= shiftExpr();
+            else if(accept(">=")) v = v >= shiftExpr();
+            else if(accept("<")) v = v < shiftExpr();
+            else if(accept(">")) v = v > shiftExpr();
+            else return v;
+        }
+    }
+    long shiftExpr()
+    {
+        long    v = addExpr();
+        for(;;){
+            if(accept("<<")) v <<= addExpr();
+            else if(accept(">>")) v >>= addExpr();
+            else return v;
+        }
+    }
+    long addExpr()
+    {
+        long    v = mulExpr();
+        for(;;){
+            if(accept("+")) v += mulExpr();
+            else if(accept("-")) v -= mulExpr();
+            else return v;
+        }
+    }
+    long mulExpr()
+    {
+        long    v = unary();
+        for(;;){
+            if(accept("*")) v *= unary();
+            else if(accept("/")) { long d = unary(); v = d ? v / d : 0; }
+            else return v;
+        }
+    }
+    long unary()
+    {
+        if(accept("!")) return !unary();
+        if(accept("-")) return -unary();
+        if(accept("~")) return ~unary();
+        if(accept("(")) { long v = orExpr(); accept(")"); return v; }
+        skip();
+        if(p < s.size() && isdigit((unsigned char)s[p])){
+            size_t  start = p;
+            while(p < s.size() && isalnum((unsigned char)s[p]))
+                p++;
+            return strtol(s.substr(start, p - start).c_str(), NULL, 0);
+        }
+        string  name = identifier();
+        if(name == "defined"){
+            bool    paren = accept("(");
+            string  macro = identifier();
+            if(paren)
+                accept(")");
+            return defines.count(macro) != 0;
+        }
+        Defines::const_iterator d = defines.find(name);
+        if(name.empty() || d == defines.end()){
+            unknown = true;
+            if(name.empty())    // something we don't understand: stop here
+                p = s.size();
+            return 0;
+        }
+        return d->second;
+    }
+};
+
+static string substitute(const Aliases &aliases, string word)
+{
+    for(int i = 0; i < 8; i++){ // "phase" -> "x4" -> "r21"
+        Aliases::const_iterator a = aliases.find(word);
+        if(a == aliases.end())
+            break;
+        word = a->second;
+    }
+    return word;
+}
+
+/* Reads a module with the .inc files it includes, resolving #if against
+ * 'defines'. Object-like #defines of an identifier are applied to mnemonics
+ * and operands, everything else is ignored.
+ */
+static bool readSource(const string &path, Defines &defines, Source &source)
+{
+    ifstream    input(path.c_str());
+    if(!input){
+        printf("%s: cannot open\n", path.c_str());
+        failures++;
+        return false;
+    }
+
+    string          name = basename(path);
+    vector<bool>    active(1, true);
+    vector<bool>    taken(1, true);
+    bool            inComment = false;
+    Macro           *macro = NULL;
+    int             number = 0;
+
+    for(string raw; getline(input, raw);){
+        number++;
+
+        // strip C comments, keeping the line count
+        string  text;
+        for(size_t i = 0; i < raw.size(); i++){
+            if(inComment){
+                if(raw.compare(i, 2, "*/") == 0){
+                    inComment = false;
+                    i++;
+                }
+            }else if(raw.compare(i, 2, "/*") == 0){
+                inComment = true;
+                i++;
+            }else{
+                text += raw[i];
+            }
+        }
+
+        string  t = trim(text);
+        if(!t.empty() && t[0] == '#'){
+            istringstream   words(t.substr(1));
+            string          directive, rest;
+            words >> directive;
+            getline(words, rest);
+            rest = trim(rest);
+            bool    outer = active.size() < 2 || active[active.size() - 2];
+
+            if(directive == "if" || directive == "ifdef" || directive == "ifndef"){
+                for(size_t i = 0; i < rest.size() && name == source.module; i++){
+                    if(rest.compare(i, 4, "USB_") == 0 && (i == 0 || !isalnum((unsigned char)rest[i - 1]))){
+                        size_t  j = i;
+                        while(j < rest.size() && (isalnum((unsigned char)rest[j]) || rest[j] == '_'))
+                            j++;
+                        source.options.insert(rest.substr(i, j - i));
+                        i = j;
+                    }
+                }
+                bool    cond;
+                if(directive == "ifdef")
+                    cond = defines.count(rest) && defines[rest] != 0;
+                else if(directive == "ifndef")
+                    cond = !(defines.count(rest) && defines[rest] != 0);
+                else
+                    cond = Expression(rest, defines).evaluate() != 0;
+                active.push_back(active.back() && cond);
+                taken.push_back(cond);
+            }else if(directive == "elif"){
+                bool    cond = !taken.back() && Expression(rest, defines).evaluate() != 0;
+                active.back() = outer && cond;
+                if(cond)
+                    taken.back() = true;
+            }else if(directive == "else"){
+                active.back() = outer && !taken.back();
+                taken.back() = true;
+            }else if(directive == "endif"){
+                if(active.size() > 1){
+                    active.pop_back();
+                    taken.pop_back();
+                }
+            }else if(active.back() && directive == "include" && rest.find(".inc") != string::npos){
+                // asmcommon.inc and the modules; C headers have no code to walk
+                readSource(directory(path) + rest.substr(1, rest.size() - 2), defines, source);
+            }else if(active.back() && directive == "define"){
+                istringstream   def(rest);
+                string          id, value;
+                def >> id;
+                getline(def, value);
+                value = trim(value);
+                char    *end;
+                long    v = strtol(value.c_str(), &end, 0);
+                if(!value.empty() && *end == 0){
+                    if(!defines.count(id))  // -D wins
+                        defines[id] = v;
+                }else if(isIdentifier(value)){
+                    source.aliases[id] = value;
+                }
+            }else if(active.back() && directive == "undef"){
+                source.aliases.erase(rest);
+            }
+            continue;
+        }
+        if(!active.back())
+            continue;
+
+        Line    line;
+        line.file = name;
+        line.number = number;
+        size_t  semicolon = text.find(';');
+        if(semicolon != string::npos){
+            line.comment = text.substr(semicolon + 1);
+            text = text.substr(0, semicolon);
+        }
+
+        t = trim(text);
+        for(size_t colon; (colon = t.find(':')) != string::npos;){
+            string  label = trim(t.substr(0, colon));
+            if(!isIdentifier(label))
+                break;
+            line.labels.push_back(label);
+            t = trim(t.substr(colon + 1));
+        }
+
+        istringstream   words(t);
+        string          mnemonic, operands;
+        words >> mnemonic;
+        getline(words, operands);
+        // USB_LOAD_PENDING(YL) and friends
+        size_t  paren = mnemonic.find('(');
+        if(paren != string::npos){
+            operands = mnemonic.substr(paren) + operands;
+            mnemonic = mnemonic.substr(0, paren);
+        }
+        line.mnemonic = lower(substitute(source.aliases, mnemonic));
+        for(istringstream ops(operands); ops.good();){
+            string  op;
+            getline(ops, op, ',');
+            op = trim(op);
+            if(!op.empty()){
+                line.rawOperands.push_back(op);
+                line.operands.push_back(substitute(source.aliases, op));
+            }
+        }
+
+        if(line.mnemonic == "macro" || line.mnemonic == ".macro"){
+            string  id = line.operands.empty() ? string() : line.operands[0];
+            istringstream   c(line.comment);
+            int             n;
+            string          unit;
+
+            if(id.empty()){  // "macro NAME" without operands parses NAME as operand
+                istringstream   w(t);
+                w >> id >> id;
+            }
+            macro = &source.macros[lower(id)];
+            macro->body.clear();
+            macro->header = line;
+            macro->declaredCycles = -1;
+            if(c >> n >> unit && unit.compare(0, 5, "cycle") == 0)
+                macro->declaredCycles = n;
+            continue;
+        }
+        if(line.mnemonic == "endm" || line.mnemonic == ".endm"){
+            macro = NULL;
+            continue;
+        }
+        if(macro){
+            if(!line.mnemonic.empty())
+                macro->body.push_back(line);
+            continue;
+        }
+        if(!line.mnemonic.empty() && line.mnemonic[0] == '.')
+            continue;   // assembler directives
+        if(line.mnemonic.empty() && line.labels.empty())
+            continue;
+        source.lines.push_back(line);
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* -------------------------- instruction timing --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+enum Flow{ FLOW_NEXT, FLOW_BRANCH, FLOW_JUMP, FLOW_RETURN, FLOW_SKIP };
+
+struct Timing{
+    int     cycles;     // branch not taken, skip not skipping
+    int     taken;      // branch taken, jump
+    Flow    flow;
+    int     words;
+};
+
+/* Classic AVR core (ATtiny, ATmega), which is what the modules are written
+ * for. Returns false for instructions without a fixed timing, e.g. user
+ * hooks such as USB_SOF_HOOK.
+ */
+static bool timing(const Source &source, const Line &line, Timing &t)
+{
+    static map<string, int> simple;
+    if(simple.empty()){
+        const char  *one[] = {"add", "adc", "sub", "subi", "sbc", "sbci", "and", "andi", "or", "ori", "eor",
+                              "com", "neg", "inc", "dec", "tst", "clr", "ser", "mov", "movw", "ldi", "in", "out",
+                              "lsl", "lsr", "rol", "ror", "asr", "swap", "bst", "bld", "sbr", "cbr", "cp", "cpc",
+                              "cpi", "sec", "clc", "sen", "cln", "sez", "clz", "sei", "cli", "ses", "cls", "sev",
+                              "clv", "set", "clt", "seh", "clh", "nop", "wdr", "sleep", "bset", "bclr", NULL};
+        const char  *two[] = {"adiw", "sbiw", "ld", "ldd", "st", "std", "push", "pop", "sbi", "cbi", "mul", "muls",
+                              "mulsu", "fmul", "fmuls", "fmulsu", "nop2", "lds", "sts", NULL};
+        for(int i = 0; one[i]; i++)
+            simple[one[i]] = 1;
+        for(int i = 0; two[i]; i++)
+            simple[two[i]] = 2;
+        simple["lpm"] = 3;
+        simple["rcall"] = 3;
+        simple["call"] = 4;
+        // usbdrvasm.S: in/out for USB_INTR_PENDING in I/O space (all tinies)
+        simple["usb_load_pending"] = 1;
+        simple["usb_store_pending"] = 1;
+    }
+
+    const string    &m = line.mnemonic;
+    t.flow = FLOW_NEXT;
+    t.words = (m == "lds" || m == "sts" || m == "jmp" || m == "call") ? 2 : 1;
+    t.taken = 0;
+
+    if(simple.count(m)){
+        t.cycles = simple[m];
+    }else if(m.size() == 4 && m.compare(0, 2, "br") == 0){
+        t.cycles = 1;
+        t.taken = 2;
+        t.flow = FLOW_BRANCH;
+    }else if(m == "rjmp" || m == "jmp"){
+        t.cycles = t.taken = m == "jmp" ? 3 : 2;
+        t.flow = FLOW_JUMP;
+        if(!line.operands.empty() && (line.operands[0] == ".+0" || line.operands[0] == "$+2"))
+            t.flow = FLOW_NEXT; // two cycle nop
+    }else if(m == "ijmp" || m == "ret" || m == "reti"){
+        t.cycles = m == "ijmp" ? 2 : 4;
+        t.flow = FLOW_RETURN;
+    }else if(m == "cpse" || m == "sbrc" || m == "sbrs" || m == "sbic" || m == "sbis"){
+        t.cycles = 1;
+        t.flow = FLOW_SKIP;
+    }else if(source.macros.count(m)){
+        const Macro &macro = source.macros.find(m)->second;
+        t.cycles = 0;
+        for(size_t i = 0; i < macro.body.size(); i++){
+            Timing  b;
+            if(!timing(source, macro.body[i], b))
+                return false;
+            t.cycles += b.cycles;
+        }
+    }else{
+        return false;
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* -------------------------------- machine -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* What the walker knows about registers (bit by bit) and flags. Loop counters
+ * such as cnt, leap and bitcnt are loaded with ldi and counted with subi, so
+ * branches on them can be decided. Bits read from the bus are unknown; both
+ * ways are followed at branches that depend on them, and each way learns
+ * what the branch implies ("breq se0" taken: the SE0 test result was zero).
+ * This keeps the walker off paths real data cannot take, such as two stuffed
+ * bits in a row.
+ */
+static const int UNKNOWN = -1;
+enum{ FLAG_C, FLAG_Z, FLAG_N, FLAG_V, FLAG_S, FLAG_T, FLAGS };
+
+struct Reg{
+    unsigned char   known;  // mask of known bits
+    unsigned char   value;  // 0 where not known
+};
+
+static Reg knownReg(int v)
+{
+    Reg r = {0xff, (unsigned char)v};
+    return r;
+}
+
+static const Reg    unknownReg = {0, 0};
+
+static bool isKnown(Reg r)  { return r.known == 0xff; }
+static int  lowest(Reg r)   { return r.value; }
+static int  highest(Reg r)  { return r.value | (~r.known & 0xff); }
+
+struct Machine{
+    Reg         r[32];
+    signed char flag[FLAGS];
+    signed char zReg, cReg; // Z set: r[zReg] == zValue; C set: r[cReg] < cValue
+    unsigned char zValue, cValue;
+    unsigned char zIsSe0;   // Z set means both lines were low
+    unsigned char se0;      // end of packet seen
+
+    Machine() : zReg(-1), cReg(-1), zValue(0), cValue(0), zIsSe0(0), se0(0)
+    {
+        for(int i = 0; i < 32; i++)
+            r[i] = unknownReg;
+        for(int i = 0; i < FLAGS; i++)
+            flag[i] = UNKNOWN;
+    }
+    void write(int d, Reg v)
+    {
+        if(d < 0)
+            return;
+        r[d] = v;
+        if(d == zReg)
+            zReg = -1;
+        if(d == cReg)
+            cReg = -1;
+    }
+    /* merges what we learnt about a register; false if it contradicts */
+    bool learn(int d, Reg v)
+    {
+        if(d < 0)
+            return true;
+        if((r[d].known & v.known & (r[d].value ^ v.value)) != 0)
+            return false;
+        r[d].value = (r[d].value & r[d].known) | (v.value & v.known);
+        r[d].known |= v.known;
+        return true;
+    }
+};
+
+/* common leading bits of a range */
+static Reg rangeReg(int low, int high)
+{
+    Reg r = unknownReg;
+    for(int bit = 7; bit >= 0 && ((low ^ high) & (1 << bit)) == 0; bit--){
+        r.known |= 1 << bit;
+        r.value |= low & (1 << bit);
+    }
+    return r;
+}
+
+static int registerNumber(const string &name)
+{
+    static const char   *pointers[] = {"XL", "XH", "YL", "YH", "ZL", "ZH"};
+
+    if(name.size() >= 2 && (name[0] == 'r' || name[0] == 'R') && isdigit((unsigned char)name[1])){
+        int n = atoi(name.c_str() + 1);
+        return n < 32 ? n : -1;
+    }
+    for(int i = 0; i < 6; i++){
+        if(name == pointers[i])
+            return 26 + i;
+    }
+    return -1;
+}
+
+static int immediate(const Line &line, size_t operand, const Defines &defines)
+{
+    if(operand >= line.operands.size())
+        return UNKNOWN;
+    Expression  e(line.operands[operand], defines);
+    long        v = e.evaluate();
+    return e.known() ? (int)(v & 0xff) : UNKNOWN;
+}
+
+/* Z and N from a result, Z remembered as "r[d] == 0" while unknown */
+static void resultFlags(Machine &m, int d, Reg res)
+{
+    if(isKnown(res))
+        m.flag[FLAG_Z] = res.value == 0;
+    else
+        m.flag[FLAG_Z] = (res.value & res.known) != 0 ? 0 : UNKNOWN;
+    m.zReg = m.flag[FLAG_Z] == UNKNOWN ? d : -1;
+    m.zValue = 0;
+    m.zIsSe0 = 0;
+    m.flag[FLAG_N] = res.known & 0x80 ? res.value >> 7 : UNKNOWN;
+    m.flag[FLAG_S] = m.flag[FLAG_N] == UNKNOWN || m.flag[FLAG_V] == UNKNOWN ? UNKNOWN : m.flag[FLAG_N] ^ m.flag[FLAG_V];
+}
+
+/* a - b - carry; writes d unless it is a compare (d < 0) */
+static void subtract(Machine &m, int d, int compared, Reg a, Reg b, bool withCarry)
+{
+    int carry = withCarry ? m.flag[FLAG_C] : 0;
+    int oldZ = m.flag[FLAG_Z];
+    Reg res = unknownReg;
+
+    if(isKnown(a) && isKnown(b) && carry != UNKNOWN){
+        int diff = a.value - b.value - carry;
+        res = knownReg(diff & 0xff);
+        m.flag[FLAG_C] = diff < 0;
+        m.flag[FLAG_V] = ((a.value ^ b.value) & (a.value ^ res.value) & 0x80) != 0;
+    }else{
+        int cmin = carry == UNKNOWN ? 0 : carry, cmax = carry == UNKNOWN ? 1 : carry;
+        m.flag[FLAG_C] = highest(a) < lowest(b) + cmin ? 1 : lowest(a) >= highest(b) + cmax ? 0 : UNKNOWN;
+        m.flag[FLAG_V] = UNKNOWN;
+    }
+    m.write(d, res);
+    resultFlags(m, d, res);
+    if(!isKnown(res) && !withCarry && isKnown(b)){
+        // Z set means a == b: remember it for the register compared
+        if((a.known & (a.value ^ b.value)) != 0){
+            m.flag[FLAG_Z] = 0;
+            m.zReg = -1;
+        }else{
+            m.zReg = compared;
+            m.zValue = b.value;
+        }
+    }
+    if(withCarry && m.flag[FLAG_Z] != 0){
+        m.flag[FLAG_Z] = oldZ == 0 ? 0 : UNKNOWN;   // sbc, sbci and cpc only ever clear Z
+        m.zReg = -1;
+    }
+    if(m.flag[FLAG_C] == UNKNOWN && !withCarry && isKnown(b) && d < 0){
+        m.cReg = compared;
+        m.cValue = b.value;
+    }else{
+        m.cReg = -1;
+    }
+    m.flag[FLAG_N] = isKnown(res) ? res.value >> 7 : UNKNOWN;
+    m.flag[FLAG_S] = m.flag[FLAG_N] == UNKNOWN || m.flag[FLAG_V] == UNKNOWN ? UNKNOWN : m.flag[FLAG_N] ^ m.flag[FLAG_V];
+}
+
+static void add(Machine &m, int d, Reg a, Reg b, bool withCarry)
+{
+    int carry = withCarry ? m.flag[FLAG_C] : 0;
+    Reg res = unknownReg;
+
+    if(isKnown(a) && isKnown(b) && carry != UNKNOWN){
+        int sum = a.value + b.value + carry;
+        res = knownReg(sum & 0xff);
+        m.flag[FLAG_C] = sum > 0xff;
+        m.flag[FLAG_V] = (~(a.value ^ b.value) & (a.value ^ res.value) & 0x80) != 0;
+    }else{
+        int cmin = carry == UNKNOWN ? 0 : carry, cmax = carry == UNKNOWN ? 1 : carry;
+        m.flag[FLAG_C] = lowest(a) + lowest(b) + cmin > 0xff ? 1 : highest(a) + highest(b) + cmax <= 0xff ? 0 : UNKNOWN;
+        m.flag[FLAG_V] = UNKNOWN;
+    }
+    m.write(d, res);
+    resultFlags(m, d, res);
+    m.cReg = -1;
+}
+
+static void logic(Machine &m, int d, Reg res)
+{
+    m.write(d, res);
+    m.flag[FLAG_V] = 0;
+    resultFlags(m, d, res);
+}
+
+/* lsr, ror, asr; the bit shifted in is 'in' (0, 1 or UNKNOWN) */
+static void shiftRight(Machine &m, int d, Reg a, int in)
+{
+    Reg res;
+    res.known = (a.known >> 1) | (in == UNKNOWN ? 0 : 0x80);
+    res.value = ((a.value >> 1) | (in == 1 ? 0x80 : 0)) & res.known;
+    m.flag[FLAG_C] = a.known & 1 ? a.value & 1 : UNKNOWN;
+    m.write(d, res);
+    m.flag[FLAG_V] = UNKNOWN;
+    resultFlags(m, d, res);
+    if(m.flag[FLAG_N] != UNKNOWN && m.flag[FLAG_C] != UNKNOWN){
+        m.flag[FLAG_V] = m.flag[FLAG_N] ^ m.flag[FLAG_C];
+        m.flag[FLAG_S] = m.flag[FLAG_N] ^ m.flag[FLAG_V];
+    }
+    m.cReg = -1;
+}
+
+static void shiftLeft(Machine &m, int d, Reg a, int in)
+{
+    Reg res;
+    res.known = ((a.known << 1) | (in == UNKNOWN ? 0 : 1)) & 0xff;
+    res.value = ((a.value << 1) | (in == 1 ? 1 : 0)) & res.known;
+    m.flag[FLAG_C] = a.known & 0x80 ? a.value >> 7 : UNKNOWN;
+    m.write(d, res);
+    m.flag[FLAG_V] = UNKNOWN;
+    resultFlags(m, d, res);
+    m.cReg = -1;
+}
+
+static void forgetFlags(Machine &m)
+{
+    for(int i = 0; i < FLAG_T; i++)
+        m.flag[i] = UNKNOWN;
+    m.zReg = m.cReg = -1;
+    m.zIsSe0 = 0;
+}
+
+static void execute(const Source &source, const Defines &defines, const Line &line, Machine &m)
+{
+    static const char   *untouched[] = {"out", "st", "std", "sts", "push", "nop", "nop2", "sbi", "cbi", "rjmp",
+                                        "jmp", "ijmp", "ret", "reti", "cpse", "sbrc", "sbrs", "sbic", "sbis",
+                                        "usb_store_pending", "sei", "cli", "wdr", "sleep", NULL};
+    static const char   *loads[] = {"in", "ld", "ldd", "lds", "pop", "usb_load_pending", NULL};
+    const string        &op = line.mnemonic;
+    int                 d = line.operands.size() > 0 ? registerNumber(line.operands[0]) : -1;
+    int                 s = line.operands.size() > 1 ? registerNumber(line.operands[1]) : -1;
+    Reg                 a = d >= 0 ? m.r[d] : unknownReg;
+    Reg                 b = s >= 0 ? m.r[s] : unknownReg;
+    int                 k = immediate(line, 1, defines);
+    Reg                 K = k == UNKNOWN ? unknownReg : knownReg(k);
+
+    if(source.macros.count(op)){
+        const Macro &macro = source.macros.find(op)->second;
+        for(size_t i = 0; i < macro.body.size(); i++)
+            execute(source, defines, macro.body[i], m);
+        return;
+    }
+    for(int i = 0; untouched[i]; i++){
+        if(op == untouched[i])
+            return;
+    }
+    if(op.size() == 4 && op.compare(0, 2, "br") == 0)
+        return;
+    for(int i = 0; loads[i]; i++){
+        if(op == loads[i]){
+            m.write(d, unknownReg);
+            return;
+        }
+    }
+
+    if(op == "ldi"){
+        m.write(d, K);
+    }else if(op == "ser"){
+        m.write(d, knownReg(0xff));
+    }else if(op == "mov"){
+        m.write(d, b);
+    }else if(op == "movw" && d >= 0 && s >= 0 && d < 31 && s < 31){
+        m.write(d, m.r[s]);
+        m.write(d + 1, m.r[s + 1]);
+    }else if(op == "clr" || (op == "eor" && d == s)){
+        logic(m, d, knownReg(0));
+    }else if(op == "subi" || op == "sbci" || op == "sub" || op == "sbc"){
+        subtract(m, d, d, a, op == "subi" || op == "sbci" ? K : b, op == "sbci" || op == "sbc");
+    }else if(op == "cpi" || op == "cp" || op == "cpc"){
+        subtract(m, -1, d, a, op == "cpi" ? K : b, op == "cpc");
+    }else if(op == "add" || op == "adc"){
+        add(m, d, a, b, op == "adc");
+    }else if(op == "inc" || op == "dec"){
+        Reg res = isKnown(a) ? knownReg((a.value + (op == "inc" ? 1 : -1)) & 0xff) : unknownReg;
+        m.flag[FLAG_V] = isKnown(res) ? res.value == (op == "inc" ? 0x80 : 0x7f) : UNKNOWN;
+        m.write(d, res);
+        resultFlags(m, d, res);
+    }else if(op == "neg"){
+        subtract(m, d, d, knownReg(0), a, false);
+    }else if(op == "and" || op == "andi" || op == "tst"){
+        Reg o = op == "andi" ? K : op == "tst" ? a : b;
+        Reg res;
+        res.known = (a.known & o.known) | (a.known & ~a.value) | (o.known & ~o.value);
+        res.value = a.value & o.value & res.known;
+        if(op == "tst"){
+            m.flag[FLAG_V] = 0;
+            resultFlags(m, d, res);
+        }else{
+            logic(m, d, res);
+        }
+        if(op == "andi" && defines.count("USBMASK") && k == (defines.find("USBMASK")->second & 0xff)){
+            m.zIsSe0 = 1;
+            m.se0 |= m.flag[FLAG_Z] == 1;
+        }
+    }else if(op == "or" || op == "ori" || op == "sbr"){
+        Reg o = op == "or" ? b : K;
+        Reg res;
+        res.known = (a.known & o.known) | (a.known & a.value) | (o.known & o.value);
+        res.value = (a.value | o.value) & res.known;
+        logic(m, d, res);
+    }else if(op == "eor"){
+        Reg res;
+        res.known = a.known & b.known;
+        res.value = (a.value ^ b.value) & res.known;
+        logic(m, d, res);
+    }else if(op == "cbr"){
+        Reg res;
+        res.known = k == UNKNOWN ? 0 : a.known | k;
+        res.value = a.value & ~k & res.known;
+        logic(m, d, res);
+    }else if(op == "com"){
+        Reg res = {a.known, (unsigned char)(~a.value & a.known)};
+        logic(m, d, res);
+        m.flag[FLAG_C] = 1;
+        m.cReg = -1;
+    }else if(op == "lsr"){
+        shiftRight(m, d, a, 0);
+    }else if(op == "ror"){
+        shiftRight(m, d, a, m.flag[FLAG_C]);
+    }else if(op == "asr"){
+        shiftRight(m, d, a, a.known & 0x80 ? a.value >> 7 : UNKNOWN);
+    }else if(op == "lsl" || (op == "add" && d == s)){
+        shiftLeft(m, d, a, 0);
+    }else if(op == "rol"){
+        shiftLeft(m, d, a, m.flag[FLAG_C]);
+    }else if(op == "swap"){
+        Reg res = {(unsigned char)((a.known << 4) | (a.known >> 4)), (unsigned char)((a.value << 4) | (a.value >> 4))};
+        m.write(d, res);
+    }else if(op == "bst"){
+        m.flag[FLAG_T] = k != UNKNOWN && (a.known >> k) & 1 ? (a.value >> k) & 1 : UNKNOWN;
+    }else if(op == "bld"){
+        Reg res = a;
+        if(k == UNKNOWN){
+            res = unknownReg;
+        }else{
+            res.known &= ~(1 << k);
+            res.value &= ~(1 << k);
+            if(m.flag[FLAG_T] != UNKNOWN){
+                res.known |= 1 << k;
+                res.value |= m.flag[FLAG_T] << k;
+            }
+        }
+        m.write(d, res);
+    }else if(op.size() == 3 && strchr("sc", op[0]) && op[1] == (op[0] == 's' ? 'e' : 'l') && strchr("cznvst", op[2])){
+        static const char   names[] = "cznvst";
+        static const int    flags[] = {FLAG_C, FLAG_Z, FLAG_N, FLAG_V, FLAG_S, FLAG_T};
+        int                 f = flags[strchr(names, op[2]) - names];
+        m.flag[f] = op[0] == 's';
+        if(f == FLAG_Z){
+            m.zReg = -1;
+            m.zIsSe0 = 0;
+        }
+        if(f == FLAG_C)
+            m.cReg = -1;
+    }else{
+        // anything else: forget what it writes
+        m.write(d, unknownReg);
+        if(d >= 0 && d < 31 && (op == "adiw" || op == "sbiw"))
+            m.write(d + 1, unknownReg);
+        if(op == "lpm" || op == "mul" || op == "muls" || op == "mulsu"){
+            m.write(0, unknownReg);
+            m.write(1, unknownReg);
+        }
+        forgetFlags(m);
+    }
+}
+
+static const struct{ const char *name; int flag, value; } branches[] = {
+    {"breq", FLAG_Z, 1}, {"brne", FLAG_Z, 0}, {"brcs", FLAG_C, 1}, {"brlo", FLAG_C, 1},
+    {"brcc", FLAG_C, 0}, {"brsh", FLAG_C, 0}, {"brmi", FLAG_N, 1}, {"brpl", FLAG_N, 0},
+    {"brlt", FLAG_S, 1}, {"brge", FLAG_S, 0}, {"brvs", FLAG_V, 1}, {"brvc", FLAG_V, 0},
+    {"brts", FLAG_T, 1}, {"brtc", FLAG_T, 0}, {NULL, 0, 0}
+};
+
+/* 1 taken (or skipping), 0 not taken, UNKNOWN */
+static int decide(const Defines &defines, const Line &line, const Machine &m)
+{
+    const string    &op = line.mnemonic;
+
+    for(int i = 0; branches[i].name; i++){
+        if(op == branches[i].name){
+            int f = m.flag[branches[i].flag];
+            return f == UNKNOWN ? UNKNOWN : f == branches[i].value;
+        }
+    }
+    if(line.operands.size() < 2)
+        return UNKNOWN;
+    int d = registerNumber(line.operands[0]);
+    Reg a = d >= 0 ? m.r[d] : unknownReg;
+    if(op == "sbrc" || op == "sbrs"){
+        int bit = immediate(line, 1, defines);
+        if(bit == UNKNOWN || !((a.known >> bit) & 1))
+            return UNKNOWN;
+        return ((a.value >> bit) & 1) == (op == "sbrs");
+    }
+    if(op == "cpse"){
+        int s = registerNumber(line.operands[1]);
+        Reg b = s >= 0 ? m.r[s] : unknownReg;
+        if(a.known & b.known & (a.value ^ b.value))
+            return 0;
+        return isKnown(a) && isKnown(b) ? 1 : UNKNOWN;
+    }
+    return UNKNOWN;
+}
+
+/* Applies what taking (or not taking) a branch or skip implies. Returns
+ * false if the machine state says the way cannot be taken.
+ */
+static bool assume(const Defines &defines, const Line &line, Machine &m, bool taken)
+{
+    const string    &op = line.mnemonic;
+
+    for(int i = 0; branches[i].name; i++){
+        if(op != branches[i].name)
+            continue;
+        int f = branches[i].flag;
+        int v = taken ? branches[i].value : !branches[i].value;
+        if(m.flag[f] != UNKNOWN)
+            return m.flag[f] == v;
+        m.flag[f] = v;
+        if(f == FLAG_Z && v == 1 && m.zReg >= 0 && !m.learn(m.zReg, knownReg(m.zValue)))
+            return false;
+        if(f == FLAG_Z && v == 1)
+            m.se0 |= m.zIsSe0;
+        if(f == FLAG_C && m.cReg >= 0){
+            Reg range = v ? rangeReg(0, m.cValue - 1) : rangeReg(m.cValue, 0xff);
+            if(v && m.cValue == 0)
+                return false;
+            if(!m.learn(m.cReg, range))
+                return false;
+        }
+        return true;
+    }
+    if(line.operands.size() < 2)
+        return true;
+    int d = registerNumber(line.operands[0]);
+    if(op == "sbrc" || op == "sbrs"){
+        int bit = immediate(line, 1, defines);
+        if(bit == UNKNOWN)
+            return true;
+        Reg r = {(unsigned char)(1 << bit), (unsigned char)((taken == (op == "sbrs")) << bit)};
+        return m.learn(d, r);
+    }
+    if(op == "cpse" && taken){
+        int s = registerNumber(line.operands[1]);
+        if(s >= 0 && d >= 0)
+            return m.learn(d, m.r[s]) && m.learn(s, m.r[d]);
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ path walker ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+/* Times are scaled by USB_BIT_KHZ so that fractional bit times stay exact:
+ * one cycle is 1500 units, one bit is 'khz' units.
+ */
+static const long   USB_BIT_KHZ = 1500;
+
+/* longest packet: sync, PID, 8 data bytes, CRC; plus stuffing */
+static const int    MAX_PACKET_BITS = (1 + 1 + 8 + 2) * 8 * 7 / 6;
+
+/* The receivers repeat themselves every three bytes at most (the leap
+ * cycles of the 16 and 20 MHz modules); one more covers stuffing across
+ * the byte boundaries.
+ */
+static const int    MAX_RX_BITS = 4 * 8 * 7 / 6;
+
+enum Event{ EVENT_RX, EVENT_TX };
+
+/* where the walker is: pc, error and since, then the machine */
+struct State{
+    unsigned char   bytes[3 * sizeof(long) + sizeof(Machine)];
+
+    bool operator==(const State &other) const
+    {
+        return memcmp(bytes, other.bytes, sizeof(bytes)) == 0;
+    }
+    size_t operator()(const State &state) const    // FNV-1a
+    {
+        size_t  hash = 2166136261u;
+        for(size_t i = 0; i < sizeof(state.bytes); i++)
+            hash = (hash ^ state.bytes[i]) * 16777619u;
+        return hash;
+    }
+};
+
+struct Walker{
+    const Source        &source;
+    const Defines       &defines;
+    string              module;
+    long                khz;
+    Event               event;
+    size_t              start;      // first event
+    map<string, size_t> labels;
+    unordered_map<State, int, State> seen;  // -> fewest bits it was reached with
+    long                worst;      // largest |error| seen, scaled
+    bool                pll;        // the receiver corrects its phase
+    set<int>            reported;
+
+    Walker(const Source &source, const Defines &defines, const string &module, long khz, Event event)
+        : source(source), defines(defines), module(module), khz(khz), event(event), start(0), worst(0), pll(false)
+    {
+        for(size_t i = 0; i < source.lines.size(); i++){
+            for(size_t l = 0; l < source.lines[i].labels.size(); l++)
+                labels[source.lines[i].labels[l]] = i;
+            if(isPhaseCorrection(source.lines[i]))
+                pll = true;
+        }
+    }
+
+    /* The receiver must hit the middle half of every bit. A PLL only learns
+     * the phase from a sample taken up to one cycle late, so it gets one
+     * more cycle. The transmitter may be one cycle off the bit boundary,
+     * plus the 1.5% data rate tolerance low speed allows.
+     */
+    long tolerance(int bits) const
+    {
+        if(event == EVENT_RX)
+            return khz / 4 + (pll ? USB_BIT_KHZ : 0);
+        return USB_BIT_KHZ + bits * khz * 15 / 1000;
+    }
+
+    bool isEvent(const Line &line) const
+    {
+        const string    &m = line.mnemonic;
+        if(event == EVENT_TX)
+            return m == "out" && line.operands.size() == 2 && line.operands[0] == "USBOUT";
+        if(m == "in")
+            return line.operands.size() == 2 && line.operands[1] == "USBIN" && line.comment.find("phase") == string::npos;
+        return (m == "sbis" || m == "sbic") && line.operands.size() == 2 && line.operands[0] == "USBIN"
+            && line.operands[1] == "USBMINUS";
+    }
+
+    /* PLL: the skip over the extra cycles in the 12.8 and 16.5 MHz modules
+     * tests the phase of the last edge. Assume it does its job and slows down
+     * when we sample early, speeds up when late.
+     */
+    bool isPhaseCorrection(const Line &line) const
+    {
+        for(size_t i = 0; i < line.rawOperands.size(); i++){
+            if(line.rawOperands[i] == "phase")
+                return true;
+        }
+        return false;
+    }
+
+    /* The transmitter sends whatever the buffer holds, so any way through
+     * its bit loop is possible; tracking the data bits would only multiply
+     * the states.
+     */
+    bool follow(const Line &line, Machine &machine, bool taken) const
+    {
+        return event == EVENT_TX || assume(defines, line, machine, taken);
+    }
+
+    size_t target(const Line &line) const
+    {
+        map<string, size_t>::const_iterator l = line.operands.empty() ? labels.end() : labels.find(line.operands.back());
+        return l == labels.end() ? source.lines.size() : l->second;
+    }
+
+    size_t next(size_t pc) const
+    {
+        for(pc++; pc < source.lines.size() && source.lines[pc].mnemonic.empty(); pc++)
+            ;
+        return pc;
+    }
+
+    /* 'error': time of the last event minus its ideal time. 'since': cycles
+     * since the last event, -1 before the first one. 'bits': bit times since
+     * the first event (transmitter only).
+     */
+    void walk(size_t pc, long error, long since, int bits, Machine machine)
+    {
+        const vector<Line>  &lines = source.lines;
+        bool                first = true;
+
+        for(;;){
+            if(pc >= lines.size())
+                return;
+            const Line  &line = lines[pc];
+            if(line.file != module)
+                return;     // asmcommon.inc: packet handling, no bit timing
+            if(machine.se0)
+                return;     // the receiver saw the end of packet
+            if(line.mnemonic.empty()){
+                pc++;
+                continue;
+            }
+            Timing  t;
+            if(!timing(source, line, t))
+                return;
+
+            if(since < 0){
+                if(pc == start || (event == EVENT_TX && isEvent(line)))
+                    since = 0;
+            }else if(isEvent(line)){
+                // the transmitter holds the line for a stuffed bit, the 12.8 MHz
+                // receiver doesn't sample it: count the bit times in between
+                long    n = (since * USB_BIT_KHZ + khz / 2) / khz;
+                if(n < 1)
+                    n = 1;
+                bits += n;
+                error += since * USB_BIT_KHZ - n * khz;
+                if(labs(error) > worst)
+                    worst = labs(error);
+                if(labs(error) > tolerance(bits)){
+                    if(!reported.count(line.number)){
+                        reported.insert(line.number);
+                        ostringstream   m;
+                        m << (event == EVENT_RX ? "sample" : "output") << " is " << (double)error / USB_BIT_KHZ
+                          << " cycles off the bit clock on some path (limit " << (double)tolerance(bits) / USB_BIT_KHZ << ")";
+                        fail(line, m.str());
+                    }
+                    return;
+                }
+                if(event == EVENT_TX && (line.comment.find("SE0") != string::npos || bits > MAX_PACKET_BITS))
+                    return;     // end of packet, the rest is EOP
+                if(event == EVENT_RX && bits > MAX_RX_BITS)
+                    return;
+                since = 0;
+            }
+
+            // no event for three bits: we left the bit loops
+            if(since >= 0 && since * USB_BIT_KHZ > 3 * khz)
+                return;
+
+            /* Paths only meet at labels. Fewer bits means a tighter transmitter
+             * tolerance and more of the packet still to come: an earlier visit
+             * with more bits proves nothing.
+             */
+            if(!line.labels.empty() || first){
+                State   state;
+                long    where[] = {(long)pc, error, since};
+                memcpy(state.bytes, where, sizeof(where));
+                memcpy(state.bytes + sizeof(where), &machine, sizeof(machine));
+                unordered_map<State, int, State>::iterator  visited = seen.insert(make_pair(state, bits + 1)).first;
+                if(visited->second <= bits)
+                    return;
+                visited->second = bits;
+            }
+            first = false;
+
+            int     decision = t.flow == FLOW_BRANCH || t.flow == FLOW_SKIP ? decide(defines, line, machine) : UNKNOWN;
+            execute(source, defines, line, machine);
+            long    after = since < 0 ? since : since + t.cycles;
+
+            if(t.flow == FLOW_RETURN){
+                return;
+            }else if(t.flow == FLOW_JUMP){
+                pc = target(line);
+            }else if(t.flow == FLOW_BRANCH){
+                if(decision != 0){
+                    Machine taken = machine;
+                    if(follow(line, taken, true))
+                        walk(target(line), error, since < 0 ? since : since + t.taken, bits, taken);
+                }
+                if(decision == 1 || !follow(line, machine, false))
+                    return;
+                pc = next(pc);
+            }else if(t.flow == FLOW_SKIP){
+                size_t  skipped = next(pc);
+                Timing  s;
+                if(skipped >= lines.size() || !timing(source, lines[skipped], s))
+                    return;
+                if(decision == UNKNOWN && since >= 0 && isPhaseCorrection(line) && error != 0)
+                    decision = (error < 0) == (s.cycles < s.words);    // take the slower way when early
+                if(decision != 0){
+                    Machine taken = machine;
+                    if(follow(line, taken, true))
+                        walk(next(skipped), error, since < 0 ? since : since + 1 + s.words, bits, taken);
+                }
+                if(decision == 1 || !follow(line, machine, false))
+                    return;
+                pc = skipped;
+            }else{
+                pc = next(pc);
+            }
+            since = after;
+        }
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/* -------------------------------- checks --------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+struct Clock{
+    double  mhz;            // nominal, 0 if the header doesn't say
+    double  minMhz, maxMhz; // 0 if the header doesn't say
+    double  cyclesPerBit;   // from the header, 0 if it doesn't say
+    int     maxLatency;     // -1 if not declared
+};
+
+static void parseHeader(const string &path, Clock &clock)
+{
+    ifstream    input(path.c_str());
+
+    clock.mhz = clock.minMhz = clock.maxMhz = clock.cyclesPerBit = 0;
+    clock.maxLatency = -1;
+    for(string line; getline(input, line);){
+        size_t  at;
+        if((at = line.find("nominal frequency:")) != string::npos){
+            sscanf(line.c_str() + at, "nominal frequency: %lf MHz -> %lf cycles per bit", &clock.mhz, &clock.cyclesPerBit);
+        }else if((at = line.find("min frequency:")) != string::npos && (at = line.find("->")) != string::npos){
+            sscanf(line.c_str() + at, "-> %lf MHz", &clock.minMhz);
+        }else if((at = line.find("max frequency:")) != string::npos && (at = line.find("->")) != string::npos){
+            sscanf(line.c_str() + at, "-> %lf MHz", &clock.maxMhz);
+        }else if((at = line.find("max allowable interrupt latency:")) != string::npos){
+            sscanf(line.c_str() + at, "max allowable interrupt latency: %d", &clock.maxLatency);
+        }
+    }
+}
+
+static void checkClock(const Line &where, const Clock &clock, long khz)
+{
+    double          mhz = khz / 1000.0;
+    ostringstream   m;
+
+    if(clock.minMhz != 0 && clock.maxMhz != 0){
+        if(mhz < clock.minMhz || mhz > clock.maxMhz)
+            m << "selected for " << mhz << " MHz but written for " << clock.minMhz << " to " << clock.maxMhz << " MHz";
+    }else if(clock.mhz != 0 && fabs(clock.mhz - mhz) > 0.001){
+        m << "selected for " << mhz << " MHz but written for " << clock.mhz << " MHz";
+    }
+    if(clock.cyclesPerBit != 0 && fabs(clock.cyclesPerBit - (double)khz / USB_BIT_KHZ) > 0.001)
+        m << "header claims " << clock.cyclesPerBit << " cycles per bit, " << mhz << " MHz gives " << (double)khz / USB_BIT_KHZ;
+    if(!m.str().empty())
+        fail(where, m.str());
+}
+
+/* The sync pattern is KJKJKJKK. The interrupt fires on the first K; the
+ * receiver must be polling in waitForK before the last J to K edge, 6 bits
+ * later, or it misses the double K.
+ */
+static void checkEntry(const Line &where, const Source &source, const Clock &clock, long khz)
+{
+    const vector<Line>  &lines = source.lines;
+    long                entry = 0;
+    bool                inVector = false;
+
+    for(size_t i = 0; i < lines.size(); i++){
+        for(size_t l = 0; l < lines[i].labels.size(); l++){
+            if(lines[i].labels[l] == "USB_INTR_VECTOR")
+                inVector = true;
+            if(lines[i].labels[l] == "waitForJ" || lines[i].labels[l] == "waitForK")
+                inVector = false;
+        }
+        Timing  t;
+        if(inVector && timing(source, lines[i], t))
+            entry += t.cycles;
+    }
+
+    long    budget = 6 * khz / USB_BIT_KHZ;
+    if(clock.maxLatency >= 0 && clock.maxLatency + entry > budget){
+        ostringstream   m;
+        m << "max interrupt latency " << clock.maxLatency << " + " << entry << " cycles entry > " << budget
+          << " cycles of sync pattern";
+        fail(where, m.str());
+    }
+    if(verbose){
+        printf("%s: %.3f cycles per bit, %ld cycles to waitForK, interrupt latency budget %ld",
+               where.file.c_str(), (double)khz / USB_BIT_KHZ, entry, budget - entry);
+        if(clock.maxLatency >= 0)
+            printf(" (declared %d)", clock.maxLatency);
+        printf("\n");
+    }
+}
+
+static void checkMacros(const Source &source)
+{
+    for(map<string, Macro>::const_iterator m = source.macros.begin(); m != source.macros.end(); ++m){
+        Line    call;
+        Timing  t;
+        call.mnemonic = m->first;
+        if(m->second.declaredCycles >= 0 && timing(source, call, t) && t.cycles != m->second.declaredCycles){
+            ostringstream   text;
+            text << "macro takes " << t.cycles << " cycles, comment says " << m->second.declaredCycles;
+            fail(m->second.header, text.str());
+        }
+    }
+}
+
+static void checkBitTiming(const Source &source, const Defines &defines, const string &module, long khz, bool report)
+{
+    const vector<Line>  &lines = source.lines;
+    Walker              rx(source, defines, module, khz, EVENT_RX);
+    Walker              tx(source, defines, module, khz, EVENT_TX);
+
+    // receiver: from foundK, counting from the data sample after the sync check
+    size_t  found = rx.labels.count("foundK") ? rx.labels["foundK"] : lines.size();
+    rx.start = found;
+    for(int n = 0; rx.start < lines.size(); rx.start++){
+        if(rx.isEvent(lines[rx.start]) && ++n == 2)
+            break;
+    }
+    if(rx.start >= lines.size()){
+        Line    where;
+        where.file = module;
+        where.number = 1;
+        fail(where, "no data sample after foundK");
+        return;
+    }
+    rx.walk(found, 0, -1, 0, Machine());
+
+    // transmitter: from usbSendAndReti to the end of packet
+    if(tx.labels.count("usbSendAndReti"))
+        tx.walk(tx.labels["usbSendAndReti"], 0, -1, 0, Machine());
+
+    if(verbose && report){
+        printf("%s: receiver within %.2f cycles of the bit clock (limit %.2f), transmitter within %.2f (limit %.2f + 1.5%%)\n",
+               module.c_str(), (double)rx.worst / USB_BIT_KHZ, (double)rx.tolerance(0) / USB_BIT_KHZ,
+               (double)tx.worst / USB_BIT_KHZ, (double)tx.tolerance(0) / USB_BIT_KHZ);
+    }
+}
+
+/* register names from usbdrvasm.S and USB_BUFSIZE from usbdrv.h */
+struct Driver{
+    Defines defines;
+    Aliases registers;
+};
+
+static void readDriver(const string &path, Driver &driver)
+{
+    Aliases aliases;
+    string  files[] = {path, directory(path) + "usbdrv.h"};
+
+    for(int f = 0; f < 2; f++){
+        ifstream    input(files[f].c_str());
+        for(string line; getline(input, line);){
+            istringstream   words(line);
+            string          define, name, value;
+            if(!(words >> define >> name >> value) || define != "#define")
+                continue;
+            if(isIdentifier(value))
+                aliases[name] = value;
+            else if(name == "USB_BUFSIZE")
+                driver.defines[name] = atol(value.c_str());
+        }
+    }
+    for(Aliases::const_iterator a = aliases.begin(); a != aliases.end(); ++a){
+        if(registerNumber(substitute(aliases, a->first)) >= 0)
+            driver.registers[a->first] = a->second;
+    }
+}
+
+static void checkModule(const string &path, long khz, const Driver &driver, const Defines &fixed)
+{
+    Clock   clock;
+    string  module = basename(path);
+    Line    where;
+
+    where.file = module;
+    where.number = 1;
+    parseHeader(path, clock);
+    checkClock(where, clock, khz);
+
+    // find the options the module tests, then try every combination
+    Source  probe;
+    Defines defines = fixed;
+    probe.module = module;
+    readSource(path, defines, probe);
+
+    vector<string>  free;
+    for(set<string>::const_iterator o = probe.options.begin(); o != probe.options.end(); ++o){
+        if(!fixed.count(*o) && *o != "USB_CFG_CLOCK_KHZ" && free.size() < 10)
+            free.push_back(*o);
+    }
+
+    int before = failures;
+    for(unsigned combination = 0; combination < (1u << free.size()); combination++){
+        Defines d = fixed;
+        Source  source;
+        int     start = failures;
+
+        d.insert(driver.defines.begin(), driver.defines.end());
+        for(size_t i = 0; i < free.size(); i++)
+            d[free[i]] = (combination >> i) & 1;
+        source.aliases = driver.registers;
+        readSource(path, d, source);
+        if(combination == 0){
+            checkEntry(where, source, clock, khz);
+            checkMacros(source);
+        }
+        checkBitTiming(source, d, module, khz, combination == 0);
+
+        if(failures != start){
+            printf("    with");
+            for(size_t i = 0; i < free.size(); i++)
+                printf(" %s=%ld", free[i].c_str(), d[free[i]]);
+            printf("\n");
+            break;  // one failing combination is enough
+        }
+    }
+    printf("%-22s %6.3f cycles/bit  %s\n", module.c_str(), (double)khz / USB_BIT_KHZ, failures == before ? "ok" : "FAILED");
+}
+
+/* usbdrvasm.S selects the module from USB_CFG_CLOCK_KHZ */
+static void checkDispatch(const string &path, const Defines &fixed)
+{
+    ifstream    input(path.c_str());
+    Driver      driver;
+    long        khz = -1;
+    int         modules = 0;
+
+    readDriver(path, driver);
+    for(string line; getline(input, line);){
+        size_t  at = line.find("USB_CFG_CLOCK_KHZ ==");
+        if(at != string::npos){
+            khz = atol(line.c_str() + at + strlen("USB_CFG_CLOCK_KHZ =="));
+            continue;
+        }
+        size_t  include = line.find("include \"usbdrvasm");
+        if(line.find('#') == string::npos || include == string::npos || khz < 0)
+            continue;
+        include += strlen("include \"");
+        checkModule(directory(path) + line.substr(include, line.find('"', include) - include), khz, driver, fixed);
+        modules++;
+        khz = -1;
+    }
+    if(modules == 0){
+        printf("%s: no modules found\n", path.c_str());
+        failures++;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- usbCrc16 -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* usbCrc16() in usbdrvasm.S comes in three versions, selected with
+ * USB_USE_FAST_CRC: 0 small, 1 fast, 2 table driven. It runs in usbPoll()
+ * for every data packet sent, not in the interrupt, so there is no budget to
+ * check; -c prints the cycles of each version instead. The length is known,
+ * the data is not: branches on it go both ways.
+ */
+struct Span{
+    long    least, most;    // cycles to the ret, -1 if there is no way
+};
+
+static const Span   noSpan = {-1, -1};
+static const Span   busySpan = {-2, -2};
+
+static Span after(long cycles, Span rest)
+{
+    if(rest.least >= 0){
+        rest.least += cycles;
+        rest.most += cycles;
+    }
+    return rest;
+}
+
+static Span merge(Span a, Span b)
+{
+    if(a.least < 0)
+        return b;
+    if(b.least >= 0){
+        a.least = min(a.least, b.least);
+        a.most = max(a.most, b.most);
+    }
+    return a;
+}
+
+struct CrcTimer{
+    const Source        &source;
+    const Defines       &defines;
+    map<string, size_t> labels;
+    unordered_map<State, Span, State>   known;
+
+    CrcTimer(const Source &source, const Defines &defines) : source(source), defines(defines)
+    {
+        for(size_t i = 0; i < source.lines.size(); i++){
+            for(size_t l = 0; l < source.lines[i].labels.size(); l++)
+                labels[source.lines[i].labels[l]] = i;
+        }
+    }
+
+    size_t target(const Line &line) const
+    {
+        map<string, size_t>::const_iterator l = line.operands.empty() ? labels.end() : labels.find(line.operands.back());
+        return l == labels.end() ? source.lines.size() : l->second;
+    }
+
+    size_t next(size_t pc) const
+    {
+        for(pc++; pc < source.lines.size() && source.lines[pc].mnemonic.empty(); pc++)
+            ;
+        return pc;
+    }
+
+    /* fewest and most cycles from pc to the ret; paths meet where the
+     * machine states do, which keeps the bit loop of the small version from
+     * doubling the paths with every bit
+     */
+    Span cycles(size_t pc, Machine machine)
+    {
+        const vector<Line>  &lines = source.lines;
+
+        while(pc < lines.size() && lines[pc].mnemonic.empty())
+            pc++;
+        if(pc >= lines.size())
+            return noSpan;
+        const Line  &line = lines[pc];
+        Timing      t;
+        if(!timing(source, line, t)){
+            fail(line, "no timing for '" + line.mnemonic + "'");
+            return noSpan;
+        }
+
+        State   state;
+        long    where[] = {(long)pc, 0, 0};
+        memcpy(state.bytes, where, sizeof(where));
+        memcpy(state.bytes + sizeof(where), &machine, sizeof(machine));
+        unordered_map<State, Span, State>::iterator seen = known.find(state);
+        if(seen != known.end()){
+            if(seen->second.least == busySpan.least){
+                fail(line, "loop count depends on the data");
+                return noSpan;
+            }
+            return seen->second;
+        }
+        known[state] = busySpan;
+
+        int     decision = t.flow == FLOW_BRANCH || t.flow == FLOW_SKIP ? decide(defines, line, machine) : UNKNOWN;
+        Span    span = noSpan;
+        execute(source, defines, line, machine);
+
+        if(t.flow == FLOW_RETURN){
+            span.least = span.most = t.cycles;
+        }else if(t.flow == FLOW_JUMP){
+            span = after(t.taken, cycles(target(line), machine));
+        }else if(t.flow == FLOW_BRANCH || t.flow == FLOW_SKIP){
+            size_t  skipped = next(pc), to = target(line);
+            int     taken = t.taken;
+            if(t.flow == FLOW_SKIP){
+                Timing  s;
+                if(skipped < lines.size() && timing(source, lines[skipped], s)){
+                    to = next(skipped);
+                    taken = 1 + s.words;
+                }
+            }
+            if(decision != 0){
+                Machine m = machine;
+                if(assume(defines, line, m, true))
+                    span = merge(span, after(taken, cycles(to, m)));
+            }
+            if(decision != 1 && assume(defines, line, machine, false))
+                span = merge(span, after(t.cycles, cycles(skipped, machine)));
+        }else{
+            span = after(t.cycles, cycles(next(pc), machine));
+        }
+        known[state] = span;
+        return span;
+    }
+
+    /* usbCrc16(data, len) on gcc: len in r22 */
+    Span call(int len)
+    {
+        Machine machine;
+
+        machine.r[22] = knownReg(len);
+        if(!labels.count("usbCrc16"))
+            return noSpan;
+        return cycles(labels["usbCrc16"], machine);
+    }
+};
+
+static void checkCrc(const string &path, const Defines &fixed)
+{
+    static const char   *names[] = {"small", "fast", "table"};
+    Driver              driver;
+
+    readDriver(path, driver);
+    for(int version = 0; version < 3; version++){
+        Defines d = fixed;
+        Source  source;
+
+        d.insert(driver.defines.begin(), driver.defines.end());
+        d["USB_USE_FAST_CRC"] = version;
+        source.module = basename(path);
+        source.aliases = driver.registers;
+        readSource(path, d, source);
+
+        CrcTimer    timer(source, d);
+        Span        none = timer.call(0), one = timer.call(1), packet = timer.call(8);
+        if(none.least < 0 || one.least < 0 || packet.least < 0){
+            printf("%s: no way through usbCrc16 with USB_USE_FAST_CRC=%d\n", path.c_str(), version);
+            failures++;
+            continue;
+        }
+
+        // code between usbCrc16 and usbCrc16Append; the table is data
+        int words = 0;
+        for(size_t pc = timer.labels["usbCrc16"]; pc < timer.labels["usbCrc16Append"]; pc++){
+            Timing  t;
+            if(timing(source, source.lines[pc], t) && !source.lines[pc].mnemonic.empty())
+                words += t.words;
+        }
+        printf("USB_USE_FAST_CRC=%d %-6s %2ld-%2ld cycles/byte, 8 bytes in %3ld-%3ld cycles, %2d words%s\n", version,
+               names[version], one.least - none.least, one.most - none.most, packet.least, packet.most, words,
+               timer.labels.count("usbCrc16TableLo") ? " + 512 byte table" : "");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Defines     fixed;
+    const char  *dispatcher = NULL;
+    bool        crc = false;
+
+    for(int i = 1; i < argc; i++){
+        string  arg = argv[i];
+        if(arg == "-v"){
+            verbose = true;
+        }else if(arg == "-c"){
+            crc = true;
+        }else if(arg.compare(0, 2, "-D") == 0){
+            size_t  eq = arg.find('=');
+            if(eq == string::npos)
+                fixed[arg.substr(2)] = 1;
+            else
+                fixed[arg.substr(2, eq - 2)] = strtol(arg.c_str() + eq + 1, NULL, 0);
+        }else{
+            dispatcher = argv[i];
+        }
+    }
+    // pin numbers don't change the timing, but the walker needs a mask
+    if(!fixed.count("USBMINUS"))
+        fixed["USBMINUS"] = 3;
+    if(!fixed.count("USBPLUS"))
+        fixed["USBPLUS"] = 4;
+    fixed["USBMASK"] = (1 << fixed["USBMINUS"]) | (1 << fixed["USBPLUS"]);
+    if(!dispatcher){
+        fprintf(stderr, "usage: usbcycles [-v] [-c] [-DNAME[=value]...] path/to/usbdrvasm.S\n");
+        return 2;
+    }
+
+    if(crc)
+        checkCrc(dispatcher, fixed);
+    else
+        checkDispatch(dispatcher, fixed);
+    if(failures){
+        printf("%d timing check(s) failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,28 @@
+/* Name: eeprom.h
+ * Project: V-USB host harness
+ *
+ * Stand-in for avr-libc's <avr/eeprom.h>: the EEPROM is an array owned by
+ * the harness (see usbhost.c), which also counts the writes.
+ */
+#ifndef __avr_eeprom_h_included__
+#define __avr_eeprom_h_included__
+
+#include <stddef.h>
+
+extern unsigned char    simEeprom[E2END + 1];
+extern int              simEepromWrites;
+
+static inline unsigned char eeprom_read_byte(const unsigned char *addr)
+{
+    return simEeprom[(size_t)addr];
+}
+
+static inline void eeprom_update_byte(unsigned char *addr, unsigned char value)
+{
+    if(simEeprom[(size_t)addr] != value){
+        simEeprom[(size_t)addr] = value;
+        simEepromWrites++;
+    }
+}
+
+#endif /* __avr_eeprom_h_included__ */
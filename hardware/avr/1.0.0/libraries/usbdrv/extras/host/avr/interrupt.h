@@ -0,0 +1,13 @@
+/* Name: interrupt.h
+ * Project: V-USB host harness
+ *
+ * Stand-in for avr-libc's <avr/interrupt.h>. The harness is single
+ * threaded; the simulated ISR only runs between calls into the driver.
+ */
+#ifndef __avr_interrupt_h_included__
+#define __avr_interrupt_h_included__
+
+#define cli()
+#define sei()
+
+#endif /* __avr_interrupt_h_included__ */
@@ -0,0 +1,23 @@
+/* Name: io.h
+ * Project: V-USB host harness
+ *
+ * Stand-in for avr-libc's <avr/io.h>: the I/O registers used by usbdrv.c
+ * are plain variables owned by the harness (see usbhost.c).
+ */
+#ifndef __avr_io_h_included__
+#define __avr_io_h_included__
+
+extern volatile unsigned char PINB, PORTB, DDRB;
+extern volatile unsigned char GIMSK, GIFR, PCMSK;
+extern volatile unsigned char SREG;
+extern volatile unsigned char OSCCAL;
+
+#define PCIE    5
+#define PCIF    5
+#define E2END   511
+
+#ifndef _BV
+#define _BV(bit) (1 << (bit))
+#endif
+
+#endif /* __avr_io_h_included__ */
@@ -0,0 +1,13 @@
+/* Name: pgmspace.h
+ * Project: V-USB host harness
+ *
+ * Stand-in for avr-libc's <avr/pgmspace.h>: flash is ordinary memory.
+ */
+#ifndef __avr_pgmspace_h_included__
+#define __avr_pgmspace_h_included__
+
+#define PROGMEM
+#define PSTR(s)             (s)
+#define pgm_read_byte(addr) (*(const unsigned char *)(addr))
+
+#endif /* __avr_pgmspace_h_included__ */
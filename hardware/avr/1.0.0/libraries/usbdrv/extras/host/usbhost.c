@@ -0,0 +1,737 @@
+/* Name: usbhost.c
+ * Project: V-USB host harness
+ * Tabsize: 4
+ * License: GNU GPL v2 (see ../../License.txt), GNU GPL v3
+ *
+ * Compiles the C part of the driver (usbdrv.c) for the build machine and
+ * drives it with SETUP/OUT/IN token sequences, so that the poll path can be
+ * regression tested and benchmarked without a device. See Makefile.
+ */
+
+/*
+General Description:
+The assembler receiver (usbdrvasm*.inc) is replaced by the sim*() functions
+below. They read and write the same variables as the real interrupt routine
+(usbRxBuf, usbRxLen, usbRxToken, usbInputBufOffset, usbCurrentTok, usbTxBuf,
+usbTxLen, usbDeviceAddr) following asmcommon.inc. The line state seen by
+usbPoll() comes from the simulated PINB register.
+
+Every request is run as a complete control transfer against the device
+configuration in USBCONFIG (TinyKeyboard by default). The reply is checked
+against the descriptors compiled into usbdrv.c and the handshakes against
+the USB spec; any mismatch makes the harness exit with status 1.
+
+The application side is a stand-in: it provides the callbacks the
+configuration asks for, the variables the usbconfig.h hooks of the libraries
+in this package touch, and zero filled descriptors of the declared length
+for those a library supplies itself (USB_CFG_DESCR_PROPS_* with a length).
+Descriptors answered by usbFunctionDescriptor() (USB_PROP_IS_DYNAMIC) are
+not supported.
+
+The string descriptors other than string 0 are declared as int arrays in
+usbdrv.c and come out twice as long on the build machine, so they are not
+requested.
+
+For every usbPoll() call the harness measures the cost on the build machine:
+retired instructions if the kernel offers a perf counter, nanoseconds
+otherwise. These numbers are a proxy for comparing revisions of usbdrv.c
+against each other. They are not AVR cycle counts: use avr-size and the
+cycle annotations in the .inc files for those.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "usbdrv.h"
+/* usbdrv.c replaces a zero USB_CFG_DESCR_PROPS_CONFIGURATION with its own */
+#if (USB_CFG_DESCR_PROPS_CONFIGURATION) & USB_PROP_IS_DYNAMIC
+#error "the harness can't check a configuration descriptor from usbFunctionDescriptor()"
+#elif USB_PROP_LENGTH(USB_CFG_DESCR_PROPS_CONFIGURATION)
+#define APP_CONFIG_LENGTH   USB_PROP_LENGTH(USB_CFG_DESCR_PROPS_CONFIGURATION)
+#endif
+#ifdef USB_RX_USER_HOOK     /* usbdrv.c defines an empty one otherwise */
+#define APP_RX_USER_HOOK    1
+#endif
+#if USB_CFG_VERIFY_RX_CRC
+static int  appCrcErrors;   /* USB_RX_CRC_ERROR_HOOK calls */
+#define USB_RX_CRC_ERROR_HOOK(data, len)    appCrcErrors++;
+#endif
+#include "usbdrv.c"
+#if USB_CFG_CALIBRATE_OSCILLATOR
+#include "osccal.c"
+#endif
+
+volatile unsigned char PINB, PORTB, DDRB;
+volatile unsigned char GIMSK, GIFR, PCMSK;
+volatile unsigned char SREG;
+volatile unsigned char OSCCAL;
+
+#define USBIDLE_STATE   _BV(USB_CFG_DMINUS_BIT) /* J state of a low speed bus */
+#define HANDSHAKE_NONE  0
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- application ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+#if USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH
+PROGMEM const char usbHidReportDescriptor[USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH];
+#endif
+
+#ifdef APP_CONFIG_LENGTH
+/* the library's own configuration descriptor, e.g. TinyRawHID's */
+PROGMEM const char usbDescriptorConfiguration[APP_CONFIG_LENGTH] = {
+    9, USBDESCR_CONFIG, APP_CONFIG_LENGTH & 0xff, APP_CONFIG_LENGTH >> 8
+};
+#else
+#define APP_CONFIG_LENGTH   sizeof(usbDescriptorConfiguration)
+#endif
+
+static uchar    appReport[8] = {0x00, 0x04};  /* modifiers, key 'a' */
+static uchar    appLastVendorRequest;
+#if USB_CFG_INTERFACE_SUBCLASS == 1
+uchar           usbKeyboardProtocol;    /* boot devices: USB_RESET_HOOK sets report protocol */
+#endif
+uchar           usbRawHIDOutToken;      /* TinyRawHID's USB_RESET_HOOK and USB_RX_USER_HOOK */
+
+#if USB_CFG_IMPLEMENT_FN_READ
+USB_PUBLIC uchar usbFunctionRead(uchar *data, uchar len)
+{
+    memset(data, 0, len);
+    return len;
+}
+#endif
+
+#if USB_CFG_IMPLEMENT_FN_WRITEOUT
+USB_PUBLIC void usbFunctionWriteOut(uchar *data, uchar len)
+{
+    (void)data;
+    (void)len;
+}
+#endif
+#if USB_CFG_IMPLEMENT_FN_WRITE
+static uchar    appOutReport[8], appOutReportLen;
+
+USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len)
+{
+    memcpy(appOutReport, data, len);
+    appOutReportLen = len;
+    return 1;
+}
+#endif
+
+USB_PUBLIC usbMsgLen_t usbFunctionSetup(uchar data[8])
+{
+usbRequest_t    *rq = (void *)data;
+
+    if((rq->bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_CLASS){
+        if(rq->bRequest == USBRQ_HID_GET_REPORT){
+            usbMsgPtr = (usbMsgPtr_t)appReport;
+            return sizeof(appReport);
+        }
+#if USB_CFG_IMPLEMENT_FN_WRITE
+        if(rq->bRequest == USBRQ_HID_SET_REPORT){
+            appOutReportLen = 0;
+            return USB_NO_MSG;  /* the data stage goes to usbFunctionWrite() */
+        }
+#endif
+    }else{
+        appLastVendorRequest = rq->bRequest;
+    }
+    return 0;
+}
+
+#if USB_CFG_HAVE_MEASURE_FRAME_LENGTH
+/* ------------------------------------------------------------------------- */
+/* -------------------------- simulated oscillator ------------------------- */
+/* ------------------------------------------------------------------------- */
+
+unsigned char   simEeprom[E2END + 1];
+int             simEepromWrites;
+
+/* OSCCAL 0 runs the RC oscillator at 60% of F_CPU and every step adds 0.3%;
+ * simOscDrift scales the result, like a change of temperature.
+ */
+static double   simOscDrift = 1;
+static int      simOscHostGone;     /* no keep-alive strobes: measurements time out */
+static int      simOscMeasurements;
+
+static unsigned simFrameLength(uchar osccal)
+{
+    return 1499 * (F_CPU * (0.6 + osccal * 0.003) * simOscDrift) / 10.5e6;
+}
+
+unsigned usbMeasureFrameLength(void)
+{
+    simOscMeasurements++;
+    return simOscHostGone ? 0 : simFrameLength(OSCCAL);
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- cost measurement ---------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static int              perfFd = -1;
+static const char       *costUnit = "ns";
+
+static void costInit(void)
+{
+#ifdef __linux__
+struct perf_event_attr  attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    perfFd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if(perfFd >= 0){
+        ioctl(perfFd, PERF_EVENT_IOC_ENABLE, 0);
+        costUnit = "insns";
+    }
+#endif
+}
+
+static unsigned long long costNow(void)
+{
+struct timespec ts;
+
+#ifdef __linux__
+    if(perfFd >= 0){
+        unsigned long long count = 0;
+        if(read(perfFd, &count, sizeof(count)) == sizeof(count))
+            return count;
+    }
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+typedef struct costStats{
+    unsigned            polls;
+    unsigned long long  total, max;
+}costStats_t;
+
+static costStats_t  pollCost;
+
+/* usbPoll() is called several times per request and the cost is kept as the
+ * minimum of several runs to filter out interrupts and cache misses.
+ */
+#define COST_RUNS   16
+
+static void measuredPoll(void)
+{
+uchar               saved[sizeof(usbRxBuf)], savedTx[sizeof(usbTxBuf)];
+uchar               rxLen = usbRxLen, txLen = usbTxLen, msgFlags = usbMsgFlags;
+uchar               newAddr = usbNewDeviceAddr, addr = usbDeviceAddr;
+usbMsgLen_t         msgLen = usbMsgLen;
+usbMsgPtr_t         msgPtr = usbMsgPtr;
+#if USB_CFG_VERIFY_RX_CRC
+usbRxDiagnostics_t  diagnostics = usbRxDiagnostics;
+int                 crcErrors = appCrcErrors;
+#endif
+unsigned long long  best = ~0ULL;
+int                 i;
+
+    memcpy(saved, usbRxBuf, sizeof(saved));
+    memcpy(savedTx, usbTxBuf, sizeof(savedTx));
+    for(i = 0; i < COST_RUNS; i++){
+        unsigned long long start;
+        if(i > 0){  /* replay the same poll on the same state */
+            memcpy(usbRxBuf, saved, sizeof(saved));
+            memcpy(usbTxBuf, savedTx, sizeof(savedTx));
+            usbRxLen = rxLen; usbTxLen = txLen; usbMsgFlags = msgFlags;
+            usbNewDeviceAddr = newAddr; usbDeviceAddr = addr;
+            usbMsgLen = msgLen; usbMsgPtr = msgPtr;
+#if USB_CFG_VERIFY_RX_CRC
+            usbRxDiagnostics = diagnostics; appCrcErrors = crcErrors;
+#endif
+        }
+        start = costNow();
+        usbPoll();
+        start = costNow() - start;
+        if(start < best)
+            best = start;
+    }
+    pollCost.polls++;
+    pollCost.total += best;
+    if(best > pollCost.max)
+        pollCost.max = best;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------ simulated receiver ISR ------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static int  failures;
+
+#define check(cond, ...)    do{ if(!(cond)){ printf("  FAIL: " __VA_ARGS__); printf("\n"); failures++; } }while(0)
+
+static unsigned crc16(const uchar *data, uchar len)
+{
+unsigned    crc = 0xffff;
+uchar       bit;
+
+    while(len--){
+        crc ^= *data++;
+        for(bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+    }
+    return crc ^ 0xffff;
+}
+
+/* Replace the assembler implementation in usbdrvasm.S. usbdrv.h passes
+ * pointers as 'unsigned', which is why the harness is linked with -no-pie.
+ */
+unsigned (usbCrc16)(unsigned data, uchar len)
+{
+    return crc16((const uchar *)(size_t)data, len);
+}
+
+unsigned (usbCrc16Append)(unsigned data, uchar len)
+{
+uchar       *p = (uchar *)(size_t)data;
+unsigned    crc = crc16(p, len);
+
+    p[len] = crc;
+    p[len + 1] = crc >> 8;
+    return crc;
+}
+
+/* token packet (SETUP, OUT or IN), see se0 in asmcommon.inc */
+static uchar simToken(uchar pid, uchar addr, uchar ep)
+{
+    if((addr << 1) != usbDeviceAddr){
+        usbCurrentTok = 0;
+        return HANDSHAKE_NONE;
+    }
+    if(pid == USBPID_SETUP || pid == USBPID_OUT){
+#if USB_CFG_IMPLEMENT_FN_WRITEOUT
+        usbCurrentTok = ep ? ep : pid;
+#else
+        (void)ep;   /* every OUT goes to endpoint 0 */
+        usbCurrentTok = pid;
+#endif
+    }
+    return HANDSHAKE_NONE;
+}
+
+static uchar simCorruptCrc;  /* damage the CRC of the next data packet */
+
+/* data packet after SETUP or OUT, see handleData in asmcommon.inc */
+static uchar simData(uchar pid, const uchar *data, uchar len)
+{
+uchar   *buf = usbRxBuf + usbInputBufOffset;
+uchar   cnt = len + 3;  /* PID and CRC */
+
+    if(!usbCurrentTok)
+        return HANDSHAKE_NONE;
+    if(usbRxLen)
+        return USBPID_NAK;
+    if(cnt < 4)         /* zero sized status stage */
+        return USBPID_ACK;
+    buf[0] = pid;
+    memcpy(buf + 1, data, len);
+    usbCrc16Append((unsigned)(size_t)(buf + 1), len);
+    buf[len + 1] ^= simCorruptCrc;  /* the interrupt routine ACKs it anyway */
+    simCorruptCrc = 0;
+    usbRxLen = cnt;
+    usbRxToken = usbCurrentTok;
+    usbInputBufOffset = USB_BUFSIZE - usbInputBufOffset;
+    return USBPID_ACK;
+}
+
+/* IN token on endpoint 0 or 1, see handleIn in asmcommon.inc and the
+ * transmitter in usbdrvasm*.inc. Returns the PID sent and copies data packets
+ * to 'out'.
+ */
+static uchar simIn(uchar ep, uchar *out, uchar *outLen)
+{
+uchar           len, *txBuf = usbTxBuf;
+volatile uchar  *txLen = &usbTxLen;
+
+    *outLen = 0;
+    if(usbRxLen > 0)    /* receive buffer not yet handled: usbRxLen is signed */
+        return USBPID_NAK;
+#if USB_CFG_HAVE_INTRIN_ENDPOINT && !USB_CFG_SUPPRESS_INTR_CODE
+    if(ep == 1){
+        txLen = &usbTxLen1;
+        txBuf = usbTxBuf1;
+    }else
+#endif
+    if(ep != 0){
+        return USBPID_NAK;
+    }
+    len = *txLen;
+    if(len & 0x10)      /* handshake token */
+        return len;
+    *txLen = USBPID_NAK;
+    len -= 4;           /* sync byte, PID and CRC */
+    check(crc16(txBuf + 1, len) == (unsigned)(txBuf[len + 1] | (txBuf[len + 2] << 8)), "bad CRC in IN data packet");
+    memcpy(out, txBuf + 1, len);
+    *outLen = len;
+    if(ep == 0)
+        usbDeviceAddr = usbNewDeviceAddr << 1;  /* assigned after a data packet */
+    return txBuf[0];
+}
+
+/* ------------------------------------------------------------------------- */
+/* -------------------------- control transfers ---------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static uchar    deviceAddr;
+
+/* Runs one control transfer with the given SETUP packet and an IN or no data
+ * stage. Returns the number of bytes received, or -1 if the device stalled.
+ */
+static int controlTransfer(const char *name, const uchar setup[8], uchar *reply, int replyMax)
+{
+uchar   packet[8], pid, len, expected = USBPID_DATA1;
+int     total = 0, tries;
+
+    memset(&pollCost, 0, sizeof(pollCost));
+    simToken(USBPID_SETUP, deviceAddr, 0);
+    check(simData(USBPID_DATA0, setup, 8) == USBPID_ACK, "%s: SETUP not acknowledged", name);
+
+    for(tries = 0; tries < 64; tries++){
+        measuredPoll();
+        simToken(USBPID_IN, deviceAddr, 0);
+        pid = simIn(0, packet, &len);
+        if(pid == USBPID_NAK)
+            continue;
+        if(pid == USBPID_STALL){
+            printf("  %-28s stalled\n", name);
+            return -1;
+        }
+        check(pid == expected, "%s: expected DATA%d, got PID 0x%02x", name, expected == USBPID_DATA1, pid);
+        expected ^= USBPID_DATA0 ^ USBPID_DATA1;
+        check(total + len <= replyMax, "%s: reply longer than %d bytes", name, replyMax);
+        if(total + len <= replyMax)
+            memcpy(reply + total, packet, len);
+        total += len;
+        if(len < 8)     /* short packet ends the data stage */
+            break;
+    }
+    check(tries < 64, "%s: no reply", name);
+
+    if(setup[0] & USBRQ_DIR_DEVICE_TO_HOST){   /* status stage: zero sized OUT */
+        simToken(USBPID_OUT, deviceAddr, 0);
+        check(simData(USBPID_DATA1, NULL, 0) == USBPID_ACK, "%s: status stage not acknowledged", name);
+        measuredPoll();
+    }
+
+    printf("  %-28s %3d bytes  %2u polls  %8llu %s total  %6llu %s max\n",
+           name, total, pollCost.polls, pollCost.total, costUnit, pollCost.max, costUnit);
+    return total;
+}
+
+static void expectReply(const char *name, const uchar setup[8], const void *expected, int expectedLen)
+{
+uchar   reply[256];
+int     len = controlTransfer(name, setup, reply, sizeof(reply));
+
+    check(len == expectedLen, "%s: got %d bytes, expected %d", name, len, expectedLen);
+    if(len == expectedLen)
+        check(memcmp(reply, expected, len) == 0, "%s: reply differs from the descriptor", name);
+}
+
+/* SE0 on the data lines long enough for usbPoll() to see a bus reset */
+static void simBusReset(void)
+{
+    PINB = 0;
+    usbPoll();
+    PINB = USBIDLE_STATE;
+    usbPoll();
+    deviceAddr = 0;
+}
+
+#define SETUP(type, request, value, index, length) \
+    {(type), (request), (value) & 0xff, (value) >> 8, (index) & 0xff, (index) >> 8, (length) & 0xff, (length) >> 8}
+
+#define IN_STANDARD     (USBRQ_DIR_DEVICE_TO_HOST | USBRQ_TYPE_STANDARD | USBRQ_RCPT_DEVICE)
+#define OUT_STANDARD    (USBRQ_DIR_HOST_TO_DEVICE | USBRQ_TYPE_STANDARD | USBRQ_RCPT_DEVICE)
+
+#if USB_CFG_IMPLEMENT_FN_WRITE
+/* HID SET_REPORT with a one byte data stage, like the LED report the host
+ * sends a keyboard: the data must reach usbFunctionWrite() and the status
+ * stage must be a zero sized DATA1.
+ */
+static void testSetReport(void)
+{
+static const uchar  setup[8] = SETUP(USBRQ_DIR_HOST_TO_DEVICE | USBRQ_TYPE_CLASS | USBRQ_RCPT_INTERFACE,
+                                     USBRQ_HID_SET_REPORT, 0x0200, 0, 1);
+static const uchar  leds[1] = {0x02};       /* Caps Lock */
+uchar               packet[8], pid = USBPID_NAK, len;
+int                 tries;
+
+    memset(&pollCost, 0, sizeof(pollCost));
+    simToken(USBPID_SETUP, deviceAddr, 0);
+    check(simData(USBPID_DATA0, setup, 8) == USBPID_ACK, "SET_REPORT: SETUP not acknowledged");
+    measuredPoll();
+    simToken(USBPID_OUT, deviceAddr, 0);
+    check(simData(USBPID_DATA1, leds, sizeof(leds)) == USBPID_ACK, "SET_REPORT: data not acknowledged");
+    for(tries = 0; tries < 8 && pid == USBPID_NAK; tries++){
+        measuredPoll();
+        simToken(USBPID_IN, deviceAddr, 0);
+        pid = simIn(0, packet, &len);
+    }
+    check(pid == USBPID_DATA1 && len == 0, "SET_REPORT: status stage is PID 0x%02x, %d bytes", pid, len);
+    check(appOutReportLen == 1 && appOutReport[0] == leds[0], "SET_REPORT: data not passed to usbFunctionWrite()");
+    printf("  %-28s %3d bytes  %2u polls  %8llu %s total  %6llu %s max\n",
+           "HID SET_REPORT", appOutReportLen, pollCost.polls, pollCost.total, costUnit, pollCost.max, costUnit);
+}
+#endif
+
+#if USB_CFG_INTR_QUEUE_SIZE
+/* Queues more interrupt reports than the queue holds and polls endpoint 1
+ * like the host would: every report must arrive once, in order, with
+ * alternating data toggles, and the one that didn't fit must be refused.
+ */
+static void testInterruptQueue(void)
+{
+uchar   report[USB_CFG_INTR_QUEUE_REPORT_LEN], packet[8], pid, len, expected = 0, toggle = 0;
+int     i, queued = 0, polls;
+
+    for(i = 0; i < USB_CFG_INTR_QUEUE_SIZE + 2; i++){
+        memset(report, i, sizeof(report));
+        if(usbQueueInterrupt(report, sizeof(report)))
+            queued++;
+    }
+    /* one goes straight to the transmit buffer */
+    check(queued == USB_CFG_INTR_QUEUE_SIZE + 1, "interrupt queue took %d of %d reports", queued, USB_CFG_INTR_QUEUE_SIZE + 2);
+    check(usbInterruptQueueIsFull(), "interrupt queue not full");
+
+    for(polls = 0; polls < 4 * USB_CFG_INTR_QUEUE_SIZE && expected < queued; polls++){
+        usbPoll();
+        simToken(USBPID_IN, deviceAddr, 1);
+        pid = simIn(1, packet, &len);
+        if(pid == USBPID_NAK)
+            continue;
+        if(expected > 0)
+            check(pid != toggle, "interrupt report %d: data toggle not alternating", expected);
+        toggle = pid;
+        memset(report, expected, sizeof(report));
+        check(len == sizeof(report) && memcmp(packet, report, len) == 0, "interrupt report %d out of order", expected);
+        expected++;
+    }
+    check(expected == queued, "%d of %d queued interrupt reports sent", expected, queued);
+    check(usbInterruptQueueIsEmpty(), "interrupt queue not drained");
+    usbPoll();
+    simToken(USBPID_IN, deviceAddr, 1);
+    check(simIn(1, packet, &len) == USBPID_NAK, "interrupt endpoint sends data after the queue drained");
+    printf("  %-28s %3d reports %2d polls\n", "interrupt queue", queued, polls);
+
+    /* a bus reset ends the session: nothing queued before it may be sent */
+    for(i = 0; i < 3; i++)
+        usbQueueInterrupt(report, sizeof(report));
+    simBusReset();
+    check(usbInterruptQueueIsEmpty() && usbInterruptIsReady(), "interrupt queue not cleared by bus reset");
+    usbPoll();
+    simToken(USBPID_IN, deviceAddr, 1);
+    check(simIn(1, packet, &len) == USBPID_NAK, "interrupt endpoint sends a report queued before the bus reset");
+    for(i = 0; i < 3; i++)
+        usbQueueInterrupt(report, sizeof(report));
+    usbInit();
+    check(usbInterruptQueueIsEmpty() && usbInterruptIsReady(), "interrupt queue not cleared by usbInit()");
+}
+#endif
+
+#if USB_CFG_VERIFY_RX_CRC
+/* A SETUP packet with a bad CRC must not reach usbFunctionSetup(): the
+ * control transfer must stall, and the next one must work again. Both
+ * packets must be counted, the bad one as an error on endpoint 0, but not
+ * the zero sized status stage of a control-in transfer.
+ */
+static void testRxCrc(void)
+{
+static const uchar  rq[8] = SETUP(USBRQ_DIR_HOST_TO_DEVICE | USBRQ_TYPE_VENDOR | USBRQ_RCPT_DEVICE, 0xb1, 0, 0, 0);
+static const uchar  rqIn[8] = SETUP(IN_STANDARD, USBRQ_GET_STATUS, 0, 0, 2);
+uchar               status[2];
+
+    memset(&usbRxDiagnostics, 0, sizeof(usbRxDiagnostics));
+    appLastVendorRequest = 0;
+    simCorruptCrc = 0x01;
+    check(controlTransfer("vendor OUT(0xb1), bad CRC", rq, NULL, 0) < 0, "bad SETUP CRC not stalled");
+    check(appLastVendorRequest == 0, "SETUP with a bad CRC passed to usbFunctionSetup()");
+    check(appCrcErrors == 1, "USB_RX_CRC_ERROR_HOOK called %d times", appCrcErrors);
+
+    check(controlTransfer("vendor OUT(0xb1)", rq, NULL, 0) == 0, "control transfer after a CRC error failed");
+    check(appLastVendorRequest == 0xb1, "SETUP after a CRC error not passed to usbFunctionSetup()");
+    check(usbRxDiagnostics.packets == 2 && usbRxDiagnostics.crcErrors == 1 && usbRxDiagnostics.controlErrors == 1,
+          "diagnostics: %u packets, %u CRC errors, %u on endpoint 0", usbRxDiagnostics.packets,
+          usbRxDiagnostics.crcErrors, usbRxDiagnostics.controlErrors);
+
+    check(controlTransfer("GET_STATUS(device)", rqIn, status, sizeof(status)) == 2, "GET_STATUS after a CRC error failed");
+    check(usbRxDiagnostics.packets == 3, "diagnostics: %u packets after a control-in transfer", usbRxDiagnostics.packets);
+}
+#endif
+
+#if USB_CFG_CALIBRATE_OSCILLATOR
+/* the OSCCAL value whose frame length is closest to F_CPU */
+static uchar idealOsccal(void)
+{
+unsigned    target = 1499 * (double)F_CPU / 10.5e6 + 0.5;
+int         i, best = 0;
+
+    for(i = 1; i < 256; i++){
+        if(abs((int)simFrameLength(i) - (int)target) < abs((int)simFrameLength(best) - (int)target))
+            best = i;
+    }
+    return best;
+}
+
+/* Resets the bus with the oscillator drifting: each reset must retune OSCCAL
+ * once, to the best value, and save it. A host that stops sending strobes
+ * must leave OSCCAL and the EEPROM alone.
+ */
+static void testCalibration(void)
+{
+static const double drifts[] = {1, 1.05, 0.96};
+uchar   saved;
+int     i, writes;
+
+    for(i = 0; i < (int)(sizeof(drifts) / sizeof(drifts[0])); i++){
+        simOscDrift = drifts[i];
+        simOscMeasurements = 0;
+        simBusReset();
+        check(OSCCAL == idealOsccal(), "drift %.2f: OSCCAL %d, best is %d", drifts[i], OSCCAL, idealOsccal());
+        check(simOscMeasurements == 8, "drift %.2f: %d frame measurements", drifts[i], simOscMeasurements);
+        check(simEeprom[USB_CFG_OSCCAL_EEPROM_ADDR] == OSCCAL && (uchar)~simEeprom[USB_CFG_OSCCAL_EEPROM_ADDR + 1] == OSCCAL,
+              "drift %.2f: OSCCAL not saved", drifts[i]);
+    }
+    simOscMeasurements = 0;
+    usbPoll();
+    check(simOscMeasurements == 0, "calibration outside of a bus reset");
+
+    saved = OSCCAL;
+    writes = simEepromWrites;
+    simOscHostGone = 1;
+    simBusReset();
+    simOscHostGone = 0;
+    check(OSCCAL == saved, "OSCCAL changed while the host was gone");
+    check(simEepromWrites == writes, "EEPROM written while the host was gone");
+
+    OSCCAL = 0;
+    restoreOscillatorCalibration();
+    check(OSCCAL == saved, "saved OSCCAL not restored");
+    simEeprom[USB_CFG_OSCCAL_EEPROM_ADDR + 1] ^= 1;
+    OSCCAL = 0;
+    restoreOscillatorCalibration();
+    check(OSCCAL == 0, "OSCCAL restored from a damaged EEPROM copy");
+    printf("  %-28s %3d EEPROM writes\n", "oscillator calibration", simEepromWrites);
+}
+#endif
+
+int main(void)
+{
+    if((size_t)usbTxBuf != (unsigned)(size_t)usbTxBuf){
+        printf("driver buffers above 4 GB: link with -no-pie\n");
+        return 1;
+    }
+    costInit();
+    PINB = USBIDLE_STATE;
+    usbInit();
+
+    printf("V-USB host harness, usbPoll() cost in %s (min of %d runs)\n", costUnit, COST_RUNS);
+
+    /* bus reset: usbPoll() sees SE0 on the data lines */
+    PINB = 0;
+    measuredPoll();
+    PINB = USBIDLE_STATE;
+    check(usbDeviceAddr == 0, "address not cleared by bus reset");
+#if USB_CFG_INTERFACE_SUBCLASS == 1
+    check(usbKeyboardProtocol == 1, "boot device not back in report protocol after bus reset");
+#endif
+
+    {
+        static const uchar rq[8] = SETUP(IN_STANDARD, USBRQ_GET_DESCRIPTOR, USBDESCR_DEVICE << 8, 0, 64);
+        expectReply("GET_DESCRIPTOR(device)", rq, usbDescriptorDevice, sizeof(usbDescriptorDevice));
+    }
+    {
+        static const uchar rq[8] = SETUP(OUT_STANDARD, USBRQ_SET_ADDRESS, 5, 0, 0);
+        controlTransfer("SET_ADDRESS(5)", rq, NULL, 0);
+        deviceAddr = 5;
+        check(usbDeviceAddr == 5 << 1, "address not taken after status stage");
+    }
+    {
+        static const uchar rq[8] = SETUP(IN_STANDARD, USBRQ_GET_DESCRIPTOR, USBDESCR_CONFIG << 8, 0, 255);
+        expectReply("GET_DESCRIPTOR(config)", rq, usbDescriptorConfiguration, APP_CONFIG_LENGTH);
+    }
+    {
+        static const uchar rq[8] = SETUP(IN_STANDARD, USBRQ_GET_DESCRIPTOR, USBDESCR_STRING << 8, 0, 255);
+        expectReply("GET_DESCRIPTOR(string 0)", rq, usbDescriptorString0, sizeof(usbDescriptorString0));
+    }
+    {
+        static const uchar rq[8] = SETUP(OUT_STANDARD, USBRQ_SET_CONFIGURATION, 1, 0, 0);
+        static const uchar config[1] = {1};
+        static const uchar rq2[8] = SETUP(IN_STANDARD, USBRQ_GET_CONFIGURATION, 0, 0, 1);
+        usbRawHIDOutToken = USBPID_DATA1;
+        controlTransfer("SET_CONFIGURATION(1)", rq, NULL, 0);
+#ifdef APP_RX_USER_HOOK
+        check(usbRawHIDOutToken == 0, "OUT data toggle not forgotten on SET_CONFIGURATION");
+#endif
+        expectReply("GET_CONFIGURATION", rq2, config, 1);
+    }
+    {
+        static const uchar status[2] = {USB_CFG_IS_SELF_POWERED, 0};
+        static const uchar rq[8] = SETUP(IN_STANDARD, USBRQ_GET_STATUS, 0, 0, 2);
+        expectReply("GET_STATUS(device)", rq, status, 2);
+    }
+    {
+        static const uchar rq[8] = SETUP(USBRQ_DIR_DEVICE_TO_HOST | USBRQ_TYPE_CLASS | USBRQ_RCPT_INTERFACE,
+                                         USBRQ_HID_GET_REPORT, 0x0100, 0, 8);
+        expectReply("HID GET_REPORT", rq, appReport, sizeof(appReport));
+    }
+    {
+        static const uchar rq[8] = SETUP(USBRQ_DIR_HOST_TO_DEVICE | USBRQ_TYPE_VENDOR | USBRQ_RCPT_DEVICE, 0xb0, 0, 0, 0);
+        controlTransfer("vendor OUT(0xb0)", rq, NULL, 0);
+        check(appLastVendorRequest == 0xb0, "vendor request not passed to usbFunctionSetup()");
+    }
+    {
+        static const uchar rq[8] = SETUP(IN_STANDARD, USBRQ_GET_DESCRIPTOR, 0x42 << 8, 0, 64);
+        uchar reply[64];
+        check(controlTransfer("GET_DESCRIPTOR(unknown)", rq, reply, sizeof(reply)) <= 0,
+              "unknown descriptor returned data");
+    }
+
+#if USB_CFG_IMPLEMENT_FN_WRITE
+    testSetReport();
+#endif
+#if USB_CFG_INTR_QUEUE_SIZE
+    testInterruptQueue();
+#endif
+#if USB_CFG_VERIFY_RX_CRC
+    testRxCrc();
+#endif
+#if USB_CFG_CALIBRATE_OSCILLATOR
+    testCalibration();
+#endif
+
+    /* a reset while configured starts the device over */
+    simBusReset();
+    check(usbDeviceAddr == 0, "address not cleared by a bus reset while configured");
+#if USB_CFG_INTERFACE_SUBCLASS == 1
+    check(usbConfiguration == 0, "keyboard still configured after a bus reset");
+#endif
+
+    memset(&pollCost, 0, sizeof(pollCost));
+    measuredPoll();
+    printf("  %-28s                    %8llu %s\n", "idle poll", pollCost.total, costUnit);
+
+    if(failures){
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,492 @@
+/* Name: isrlint.cpp
+ * Project: V-USB interrupt latency lint
+ * Tabsize: 4
+ * License: GNU GPL v2 (see ../../License.txt), GNU GPL v3
+ *
+ *   isrlint [-v] [-f MHz | -b cycles] [-m mcu] [-u vector] sketch.elf
+ *
+ * Finds the interrupt handlers in a linked sketch that can keep the V-USB
+ * interrupt waiting for longer than its receiver allows. Exits with status 1
+ * if one does. See Makefile and libraries/UsbLatency for the measurement on
+ * the device.
+ */
+
+/*
+General Description:
+V-USB has to be in its interrupt routine before the sync pattern of a packet
+is over. Any other handler that runs with interrupts disabled delays it by
+up to its whole run time, so the longest such run has to stay below the
+interrupt disable budget of the receiver module (see usbdrvasm12.inc,
+usbdrvasm165.inc and extras/cycles).
+
+The lint reads the ELF file, finds every __vector_N function and follows all
+paths from its entry, through calls, to the point where interrupts come back
+on: the reti, or the first sei. Handlers declared ISR_NOBLOCK start with sei
+and cost only the interrupt response. The cycle count is
+  4 (interrupt response) + vector table jump + longest path,
+with the classic AVR core instruction timing. Paths through a loop or an
+indirect jump or call can't be bounded and are reported as such; a loop may
+well be short, but the lint can't tell.
+
+The USB interrupt itself is recognized by V-USB's local labels (waitForJ) and
+left out; -u overrides that. Vector names come from the device, which is read
+from the .note.gnu.avr.deviceinfo section that newer toolchains write, or from
+-m. The budget comes from the clock (-f) or is given directly (-b).
+*/
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static bool verbose;
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- ELF file -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+#define SHT_SYMTAB      2
+#define SHF_ALLOC       2
+#define SHF_EXECINSTR   4
+#define STT_FUNC        2
+#define EM_AVR          83
+
+struct Image{
+    vector<unsigned char>   flash;
+    map<unsigned, string>   symbols;        // address -> name, functions first
+    map<string, unsigned>   addresses;      // name -> address
+    string                  device;
+};
+
+static unsigned get16(const string &data, size_t offset)
+{
+    return (unsigned char)data[offset] | (unsigned char)data[offset + 1] << 8;
+}
+
+static unsigned get32(const string &data, size_t offset)
+{
+    return get16(data, offset) | get16(data, offset + 2) << 16;
+}
+
+static bool readElf(const char *path, Image &image)
+{
+    ifstream        input(path, ios::binary);
+    stringstream    buffer;
+
+    buffer << input.rdbuf();
+    string  elf = buffer.str();
+    if(!input || elf.size() < 52 || elf.compare(0, 4, "\177ELF") != 0){
+        fprintf(stderr, "%s: not an ELF file\n", path);
+        return false;
+    }
+    if(elf[4] != 1 || elf[5] != 1 || get16(elf, 18) != EM_AVR){
+        fprintf(stderr, "%s: not a 32 bit little endian AVR ELF file\n", path);
+        return false;
+    }
+
+    unsigned    shoff = get32(elf, 32), shentsize = get16(elf, 46), shnum = get16(elf, 48);
+    unsigned    shstrndx = get16(elf, 50);
+    if(shoff + (size_t)shnum * shentsize > elf.size() || shstrndx >= shnum){
+        fprintf(stderr, "%s: bad section header table\n", path);
+        return false;
+    }
+    size_t  names = get32(elf, shoff + shstrndx * shentsize + 16);
+
+    for(unsigned i = 0; i < shnum; i++){
+        size_t      header = shoff + i * shentsize;
+        string      name = elf.c_str() + names + get32(elf, header);
+        unsigned    type = get32(elf, header + 4), flags = get32(elf, header + 8);
+        unsigned    addr = get32(elf, header + 12), offset = get32(elf, header + 16);
+        unsigned    size = get32(elf, header + 20), link = get32(elf, header + 24);
+        unsigned    entsize = get32(elf, header + 36);
+
+        if(offset + (size_t)size > elf.size())
+            continue;
+        if((flags & SHF_ALLOC) && (flags & SHF_EXECINSTR)){
+            if(image.flash.size() < addr + size)
+                image.flash.resize(addr + size, 0xff);
+            memcpy(&image.flash[addr], elf.data() + offset, size);
+        }else if(name == ".note.gnu.avr.deviceinfo"){
+            // the device name is the only string starting with "at" in it
+            string  note = elf.substr(offset, size);
+            size_t  at = note.find("\0at", 0, 3);
+            if(at != string::npos)
+                image.device = note.c_str() + at + 1;
+        }else if(type == SHT_SYMTAB && entsize >= 16 && link < shnum){
+            size_t  strings = get32(elf, shoff + link * shentsize + 16);
+            for(unsigned s = 0; s + entsize <= size; s += entsize){
+                string      symbol = elf.c_str() + strings + get32(elf, offset + s);
+                unsigned    value = get32(elf, offset + s + 4);
+                unsigned    info = (unsigned char)elf[offset + s + 12];
+                if(symbol.empty() || value >= 0x800000)    // RAM and EEPROM
+                    continue;
+                image.addresses[symbol] = value;
+                if(!image.symbols.count(value) || (info & 0xf) == STT_FUNC)
+                    image.symbols[value] = symbol;
+            }
+        }
+    }
+    if(image.flash.empty()){
+        fprintf(stderr, "%s: no code\n", path);
+        return false;
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- instructions ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+enum Kind{
+    PLAIN, BRANCH, SKIP, JUMP, CALL, RET, RETI, SEI, INDIRECT
+};
+
+struct Insn{
+    Kind        kind;
+    int         words;
+    int         cycles;     // not taken / not skipped
+    unsigned    target;     // byte address of BRANCH, JUMP and CALL
+};
+
+static unsigned word(const Image &image, unsigned address)
+{
+    if(address + 1 >= image.flash.size())
+        return 0xffff;
+    return image.flash[address] | image.flash[address + 1] << 8;
+}
+
+static Insn decode(const Image &image, unsigned address)
+{
+    unsigned    w = word(image, address);
+    Insn        insn = {PLAIN, 1, 1, 0};
+
+    if((w & 0xfe0f) == 0x9000 || (w & 0xfe0f) == 0x9200){     // lds, sts
+        insn.words = 2;
+        insn.cycles = 2;
+    }else if((w & 0xfe0e) == 0x940c || (w & 0xfe0e) == 0x940e){   // jmp, call
+        insn.kind = (w & 2) ? CALL : JUMP;
+        insn.words = 2;
+        insn.cycles = (w & 2) ? 4 : 3;
+        insn.target = ((((w >> 3) & 0x3e) | (w & 1)) << 16 | word(image, address + 2)) * 2;
+    }else if((w & 0xe000) == 0xc000){                           // rjmp, rcall
+        int k = w & 0xfff;
+        if(k & 0x800)
+            k -= 0x1000;
+        insn.kind = (w & 0x1000) ? CALL : JUMP;
+        insn.cycles = (w & 0x1000) ? 3 : 2;
+        insn.target = (address + 2 + 2 * k) & 0xffff;
+    }else if((w & 0xf800) == 0xf000){                           // brbs, brbc
+        int k = (w >> 3) & 0x7f;
+        if(k & 0x40)
+            k -= 0x80;
+        insn.kind = BRANCH;
+        insn.target = address + 2 + 2 * k;
+    }else if((w & 0xfc00) == 0x1000 || (w & 0xfc08) == 0xfc00 || (w & 0xfd00) == 0x9900){
+        insn.kind = SKIP;                                       // cpse, sbrc/sbrs, sbic/sbis
+    }else if(w == 0x9508){
+        insn.kind = RET;
+        insn.cycles = 4;
+    }else if(w == 0x9518){
+        insn.kind = RETI;
+        insn.cycles = 4;
+    }else if(w == 0x9478){
+        insn.kind = SEI;
+    }else if(w == 0x9409 || w == 0x9419 || w == 0x9509 || w == 0x9519){   // [e]ijmp, [e]icall
+        insn.kind = INDIRECT;
+        insn.cycles = 3;
+    }else if(w == 0x95c8 || (w & 0xfe0e) == 0x9004 || w == 0x95d8 || (w & 0xfe0e) == 0x9006){
+        insn.cycles = 3;                                        // lpm, elpm
+    }else if((w & 0xfc00) == 0x9000 || (w & 0xd000) == 0x8000 || (w & 0xfe00) == 0x9600 ||
+             (w & 0xfd00) == 0x9800 || (w & 0xfc00) == 0x9c00 || (w & 0xff00) == 0x0200 ||
+             (w & 0xff00) == 0x0300){
+        insn.cycles = 2;    // ld/st, push/pop, ldd/std, adiw/sbiw, cbi/sbi, mul*
+    }
+    return insn;
+}
+
+/* ------------------------------------------------------------------------- */
+/* -------------------------------- paths ---------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* Longest number of cycles from an instruction to the point where interrupts
+ * come back on (toEnd), or to the ret of the function it is in (toReturn).
+ * -1 means there is no such path.
+ */
+struct Cost{
+    long    toEnd;
+    long    toReturn;
+    string  unbounded;      // why the cost is only a lower bound
+
+    Cost(): toEnd(-1), toReturn(-1) {}
+};
+
+class Walker{
+public:
+    explicit Walker(const Image &image): image(image) {}
+    Cost    cost(unsigned address);
+
+private:
+    const Image             &image;
+    map<unsigned, Cost>     done;
+    set<unsigned>           active;
+
+    string  where(unsigned address) const;
+};
+
+static long add(long a, long b)
+{
+    return a < 0 || b < 0 ? -1 : a + b;
+}
+
+static void merge(Cost &into, const Cost &other, long cycles)
+{
+    into.toEnd = max(into.toEnd, add(other.toEnd, cycles));
+    into.toReturn = max(into.toReturn, add(other.toReturn, cycles));
+    if(into.unbounded.empty())
+        into.unbounded = other.unbounded;
+}
+
+string Walker::where(unsigned address) const
+{
+    char    buffer[80];
+    map<unsigned, string>::const_iterator s = image.symbols.upper_bound(address);
+
+    if(s == image.symbols.begin()){
+        snprintf(buffer, sizeof(buffer), "0x%04x", address);
+    }else{
+        --s;
+        snprintf(buffer, sizeof(buffer), "0x%04x (%s+%u)", address, s->second.c_str(), address - s->first);
+    }
+    return buffer;
+}
+
+Cost Walker::cost(unsigned address)
+{
+    map<unsigned, Cost>::const_iterator known = done.find(address);
+    if(known != done.end())
+        return known->second;
+
+    Cost    result;
+    if(active.count(address)){
+        result.unbounded = "loop at " + where(address);
+        return result;  // the path around the loop counts once
+    }
+    if(address + 1 >= image.flash.size()){
+        result.unbounded = "runs off the code at " + where(address);
+        return result;
+    }
+
+    Insn        insn = decode(image, address);
+    unsigned    next = address + 2 * insn.words;
+
+    active.insert(address);
+    switch(insn.kind){
+    case PLAIN:
+        merge(result, cost(next), insn.cycles);
+        break;
+    case BRANCH:
+        merge(result, cost(next), 1);
+        merge(result, cost(insn.target), 2);
+        break;
+    case SKIP:{
+        int skipped = decode(image, next).words;
+        merge(result, cost(next), 1);
+        merge(result, cost(next + 2 * skipped), 1 + skipped);
+        break;
+    }
+    case JUMP:
+        merge(result, cost(insn.target), insn.cycles);
+        break;
+    case CALL:{
+        Cost    callee = cost(insn.target);
+        Cost    after = cost(next);
+        result.toEnd = max(add(callee.toEnd, insn.cycles), add(add(callee.toReturn, after.toEnd), insn.cycles));
+        result.toReturn = add(add(callee.toReturn, after.toReturn), insn.cycles);
+        result.unbounded = !callee.unbounded.empty() ? callee.unbounded : after.unbounded;
+        break;
+    }
+    case RET:
+        result.toReturn = insn.cycles;
+        break;
+    case RETI:
+    case SEI:   // the next instruction still runs first, but can't be delayed further
+        result.toEnd = insn.cycles;
+        break;
+    case INDIRECT:
+        result.toEnd = insn.cycles;
+        result.unbounded = "indirect jump or call at " + where(address);
+        break;
+    }
+    active.erase(address);
+
+    // with a loop on the way this is a lower bound for other ways in, too
+    done[address] = result;
+    return result;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- devices --------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static const char   *tinyX5Vectors[] = {
+    "RESET", "INT0", "PCINT0", "TIMER1_COMPA", "TIMER1_OVF", "TIMER0_OVF", "EE_READY",
+    "ANA_COMP", "ADC", "TIMER1_COMPB", "TIMER0_COMPA", "TIMER0_COMPB", "WDT", "USI_START",
+    "USI_OVF", NULL
+};
+
+static const char   *tinyX4Vectors[] = {
+    "RESET", "INT0", "PCINT0", "PCINT1", "WDT", "TIM1_CAPT", "TIM1_COMPA", "TIM1_COMPB",
+    "TIM1_OVF", "TIM0_COMPA", "TIM0_COMPB", "TIM0_OVF", "ANA_COMP", "ADC", "EE_RDY",
+    "USI_STR", "USI_OVF", NULL
+};
+
+static string vectorName(const string &device, int number)
+{
+    const char  **names = NULL;
+
+    if(device == "attiny25" || device == "attiny45" || device == "attiny85")
+        names = tinyX5Vectors;
+    else if(device == "attiny24" || device == "attiny44" || device == "attiny84")
+        names = tinyX4Vectors;
+    for(int i = 0; names && names[i]; i++){
+        if(i == number)
+            return string(names[i]) + "_vect";
+    }
+    return "";
+}
+
+/* interrupt disable budget of the receiver module selected for the clock,
+ * from the latency extras/cycles computes minus response and longest insn
+ */
+static long budgetForClock(long khz)
+{
+    static const long   budgets[][2] = {
+        {12000, 25}, {12800, 39}, {15000, 48}, {16000, 50}, {16500, 52}, {18000, 58}, {20000, 66}
+    };
+
+    for(size_t i = 0; i < sizeof(budgets) / sizeof(budgets[0]); i++){
+        if(budgets[i][0] == khz)
+            return budgets[i][1];
+    }
+    return -1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void usage()
+{
+    fprintf(stderr, "usage: isrlint [-v] [-f MHz | -b cycles] [-m mcu] [-u vector] sketch.elf\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char  *path = NULL;
+    long        budget = -1;
+    int         usbVector = -1;
+    string      device;
+
+    for(int i = 1; i < argc; i++){
+        string  arg = argv[i];
+        if(arg == "-v"){
+            verbose = true;
+        }else if((arg == "-f" || arg == "-b" || arg == "-m" || arg == "-u") && i + 1 < argc){
+            const char  *value = argv[++i];
+            if(arg == "-f"){
+                budget = budgetForClock(atof(value) * 1000 + 0.5);
+                if(budget < 0){
+                    fprintf(stderr, "isrlint: V-USB has no receiver for %s MHz\n", value);
+                    return 2;
+                }
+            }else if(arg == "-b"){
+                budget = atol(value);
+            }else if(arg == "-m"){
+                device = value;
+            }else{
+                usbVector = atoi(value);
+            }
+        }else if(arg[0] != '-' && !path){
+            path = argv[i];
+        }else{
+            usage();
+        }
+    }
+    if(!path || budget < 0)
+        usage();
+
+    Image   image;
+    if(!readElf(path, image))
+        return 2;
+    if(device.empty())
+        device = image.device;
+
+    // rjmp or jmp vector table
+    int     vectorSize = (word(image, 0) & 0xf000) == 0xc000 ? 2 : 4;
+    int     vectorCycles = vectorSize == 2 ? 2 : 3;
+
+    map<int, unsigned>  vectors;
+    for(map<string, unsigned>::const_iterator s = image.addresses.begin(); s != image.addresses.end(); ++s){
+        if(s->first.compare(0, 9, "__vector_") == 0 && isdigit((unsigned char)s->first[9]))
+            vectors[atoi(s->first.c_str() + 9)] = s->second;
+    }
+
+    // the USB interrupt is the vector right below V-USB's receiver loop
+    if(usbVector < 0 && image.addresses.count("waitForJ")){
+        unsigned    receiver = image.addresses["waitForJ"], best = 0;
+        for(map<int, unsigned>::const_iterator v = vectors.begin(); v != vectors.end(); ++v){
+            if(v->second <= receiver && v->second >= best){
+                best = v->second;
+                usbVector = v->first;
+            }
+        }
+    }
+    if(usbVector < 0)
+        printf("no V-USB interrupt found, checking every handler\n");
+
+    Walker  walker(image);
+    int     failures = 0;
+
+    for(map<int, unsigned>::const_iterator v = vectors.begin(); v != vectors.end(); ++v){
+        string  name = vectorName(device, v->first);
+        char    label[40];
+
+        snprintf(label, sizeof(label), "__vector_%d", v->first);
+        if(!name.empty())
+            name = string(label) + " " + name;
+        else
+            name = label;
+
+        if(v->first == usbVector){
+            printf("%-28s USB interrupt, not checked\n", name.c_str());
+            continue;
+        }
+
+        Cost    cost = walker.cost(v->second);
+        long    cycles = 4 + vectorCycles + max(cost.toEnd, cost.toReturn);
+        bool    noBlock = decode(image, v->second).kind == SEI;
+        bool    ok = cost.unbounded.empty() && cycles <= budget;
+
+        printf("%-28s %s %4ld cycles%s  %s\n", name.c_str(), noBlock ? "ISR_NOBLOCK" : "blocks     ",
+               cycles, cost.unbounded.empty() ? "" : "+", ok ? "ok" : "THREATENS USB");
+        if(!cost.unbounded.empty())
+            printf("    unbounded: %s\n", cost.unbounded.c_str());
+        if(verbose)
+            printf("    entry 0x%04x, %d response + %d vector + %ld handler, budget %ld\n",
+                   v->second, 4, vectorCycles, cycles - 4 - vectorCycles, budget);
+        if(!ok)
+            failures++;
+    }
+    if(failures){
+        printf("%d handler(s) can delay the USB interrupt beyond %ld cycles\n", failures, budget);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+/* Name: osccal.c
+ * Project: tinyAVR for Arduino, oscillator calibration for V-USB
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt), GNU GPL v3
+ */
+
+#include "usbdrv.h"
+
+#if USB_CFG_CALIBRATE_OSCILLATOR
+
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include "osccal.h"
+
+#if !USB_CFG_HAVE_MEASURE_FRAME_LENGTH
+#error "USB_CFG_CALIBRATE_OSCILLATOR needs USB_CFG_HAVE_MEASURE_FRAME_LENGTH"
+#endif
+
+/* usbMeasureFrameLength() counts in units of 7 cycles and misses one low
+ * speed bit: 1499 at 10.5 MHz.
+ */
+#define OSCCAL_TARGET       ((unsigned)(1499 * (double)F_CPU / 10.5e6 + 0.5))
+/* results further off than this (2%) are not saved */
+#define OSCCAL_TOLERANCE    ((int)OSCCAL_TARGET / 50)
+
+/* the value is saved together with its complement, so that erased (0xff)
+ * or foreign EEPROM contents are not mistaken for a calibration
+ */
+void    restoreOscillatorCalibration(void)
+{
+uchar   value = eeprom_read_byte((uchar *)USB_CFG_OSCCAL_EEPROM_ADDR);
+
+    if((uchar)~value == eeprom_read_byte((uchar *)USB_CFG_OSCCAL_EEPROM_ADDR + 1))
+        OSCCAL = value;
+}
+
+static void saveOscillatorCalibration(uchar value)
+{
+    eeprom_update_byte((uchar *)USB_CFG_OSCCAL_EEPROM_ADDR, value);
+    eeprom_update_byte((uchar *)USB_CFG_OSCCAL_EEPROM_ADDR + 1, ~value);
+}
+
+void    calibrateOscillator(void)
+{
+uchar       step = 128;
+uchar       trialValue = 0, optimumValue = OSCCAL, previousValue = OSCCAL;
+uchar       sreg = SREG;
+unsigned    x;
+int         deviation, optimumDeviation = 0x7fff;
+
+    cli();
+    /* binary search: the frame gets longer as OSCCAL goes up. It measures
+     * both values on either side of the target, so the best one measured is
+     * the result; one frame each keeps it inside the 10 ms the host waits
+     * after a reset.
+     */
+    do{
+        OSCCAL = trialValue + step;
+        x = usbMeasureFrameLength();
+        if(x == 0)  /* timed out: no strobes, the host is gone */
+            goto failed;
+        deviation = x - OSCCAL_TARGET;
+        if(deviation < 0)
+            deviation = -deviation;
+        if(deviation < optimumDeviation){
+            optimumDeviation = deviation;
+            optimumValue = trialValue + step;
+        }
+        if(x < OSCCAL_TARGET)
+            trialValue += step;
+        step >>= 1;
+    }while(step > 0);
+    OSCCAL = optimumValue;
+    SREG = sreg;
+    if(optimumDeviation <= OSCCAL_TOLERANCE)
+        saveOscillatorCalibration(optimumValue);
+    return;
+
+failed:
+    OSCCAL = previousValue;
+    SREG = sreg;
+}
+
+#endif /* USB_CFG_CALIBRATE_OSCILLATOR */
@@ -0,0 +1,53 @@
+/* Name: osccal.h
+ * Project: tinyAVR for Arduino, oscillator calibration for V-USB
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt), GNU GPL v3
+ */
+
+#ifndef __osccal_h_included__
+#define __osccal_h_included__
+
+/*
+General Description:
+This module tunes the internal RC oscillator to F_CPU against the 1 ms frame
+period of the USB host, for boards without a crystal. It is compiled in when
+usbconfig.h defines USB_CFG_CALIBRATE_OSCILLATOR to 1, which also requires
+USB_CFG_HAVE_MEASURE_FRAME_LENGTH.
+
+The driver calls calibrateOscillator() from usbPoll() at the end of every USB
+reset, so a device that drifted far enough to lose packets is retuned when
+the host resets it. It is a binary search over the whole OSCCAL range, one
+frame per step, and takes 8 to 9 ms with interrupts disabled. The host sends
+nothing for 10 ms after a reset (reset recovery), so this only fits if
+usbPoll() runs within about a millisecond of the end of the reset; a request
+the device misses is sent again by the host. The first step picks one of
+the two overlapping halves of the range on the ATtiny25/45/85, so the
+search does not depend on OSCCAL being monotonic across them.
+
+It is off unless usbconfig.h or the build sets USB_CFG_CALIBRATE_OSCILLATOR,
+because it costs flash the ATtiny45 hardly has: this module,
+usbMeasureFrameLength() and the EEPROM access.
+
+A good result is saved to EEPROM, and usbInit() starts from the saved value
+(restoreOscillatorCalibration()), so the device enumerates at the right clock
+even if the bootloader was skipped. The value takes two bytes at
+USB_CFG_OSCCAL_EEPROM_ADDR, the last two bytes of the EEPROM unless defined
+otherwise in usbconfig.h; sketches must not use them.
+*/
+
+#ifndef USB_CFG_OSCCAL_EEPROM_ADDR
+#define USB_CFG_OSCCAL_EEPROM_ADDR  (E2END - 1)
+#endif
+
+void    calibrateOscillator(void);
+/* Tunes OSCCAL against the USB frame length. It must be called immediately
+ * after a USB reset, while the host sends nothing but keep-alive strobes.
+ * Interrupts are disabled while it runs. OSCCAL is left unchanged if the
+ * host stops sending strobes; the result is only saved if it comes within
+ * 2% of F_CPU. It takes 8 frames.
+ */
+void    restoreOscillatorCalibration(void);
+/* Loads OSCCAL from EEPROM if calibrateOscillator() saved a value before.
+ */
+
+#endif /* __osccal_h_included__ */
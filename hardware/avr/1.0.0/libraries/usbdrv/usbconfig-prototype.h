@@ -112,7 +112,18 @@ section at the end of this file).
 #define USB_CFG_INTR_POLL_INTERVAL      10
 /* If you compile a version with endpoint 1 (interrupt-in), this is the poll
  * interval. The value is in milliseconds and must not be less than 10 ms for
- * low speed devices.
+ * low speed devices. Linux nevertheless polls low speed devices at 1 to 9 ms
+ * if asked to; other hosts may poll no faster than every 8 ms. Hosts round
+ * the interval down to a power of two, so 10 ms is polled every 8 ms.
+ */
+#define USB_CFG_INTR_QUEUE_SIZE         0
+/* Define this to the number of messages usbQueueInterrupt() can hold for the
+ * interrupt-in endpoint 1, or to 0 to leave the queue out. usbPoll() sends
+ * one message per poll interval. Each entry takes
+ * USB_CFG_INTR_QUEUE_REPORT_LEN + 1 bytes of RAM.
+ */
+#define USB_CFG_INTR_QUEUE_REPORT_LEN   8
+/* The longest message usbQueueInterrupt() accepts, up to 8 bytes.
  */
 #define USB_CFG_IS_SELF_POWERED         0
 /* Define this to 1 if the device has its own power supply. Set it to 0 if the
@@ -162,6 +173,12 @@ section at the end of this file).
  * proceed, do a return after doing your things. One possible application
  * (besides debugging) is to flash a status LED on each packet.
  */
+/* #define USB_RX_CRC_ERROR_HOOK(data, len)    resendRequested = 1; */
+/* This macro (if defined) is executed in usbPoll() when USB_CFG_VERIFY_RX_CRC
+ * finds a data packet with a bad CRC, before the packet is dropped.
+ * usbRxToken tells where it was going. Use it to ask the host for the data
+ * again in your own protocol, or to count errors per endpoint.
+ */
 /* #define USB_RESET_HOOK(resetStarts)     if(!resetStarts){hadUsbReset();} */
 /* This macro is a hook if you need to know when an USB RESET occurs. It has
  * one parameter which distinguishes between the start of RESET state and its
@@ -176,6 +193,13 @@ section at the end of this file).
  * counts SOF packets. This feature requires that the hardware interrupt is
  * connected to D- instead of D+.
  */
+#ifndef USB_COUNT_INTERRUPTS
+#define USB_COUNT_INTERRUPTS            0
+#endif
+/* define this macro to 1 if you need the global variable "usbIntrCount"
+ * which counts returns from the USB interrupt. The UsbLatency library needs
+ * it; it costs 5 cycles at the end of every interrupt.
+ */
 /* #ifdef __ASSEMBLER__
  * macro myAssemblerMacro
  *     in      YL, TCNT0
@@ -207,13 +231,29 @@ section at the end of this file).
 /* define this macro to 1 if you want the function usbMeasureFrameLength()
  * compiled in. This function can be used to calibrate the AVR's RC oscillator.
  */
+#define USB_CFG_CALIBRATE_OSCILLATOR        0
+/* define this macro to 1 to tune OSCCAL against the USB frame length at the
+ * end of every USB reset and keep the result in EEPROM (see osccal.h). It
+ * needs usbMeasureFrameLength() and is only for devices clocked by the
+ * internal RC oscillator.
+ */
+#define USB_CFG_VERIFY_RX_CRC           0
+/* define this macro to 1 to check the CRC of every data packet received, in
+ * usbPoll(). The packet has been ACKed by then, so a bad one is dropped: on
+ * endpoint 0 the control transfer is answered with STALL, on other endpoints
+ * USB_RX_CRC_ERROR_HOOK may ask for the data again. The results are counted
+ * in usbRxDiagnostics. Unlike USB_CFG_CHECK_CRC this works at every clock
+ * rate, but usbCrc16() runs in usbPoll() for each packet: choose a faster
+ * USB_USE_FAST_CRC below if that matters.
+ */
 #define USB_USE_FAST_CRC                0
-/* The assembler module has two implementations for the CRC algorithm. One is
- * faster, the other is smaller. This CRC routine is only used for transmitted
- * messages where timing is not critical. The faster routine needs 31 cycles
- * per byte while the smaller one needs 61 to 69 cycles. The faster routine
- * may be worth the 32 bytes bigger code size if you transmit lots of data and
- * run the AVR close to its limit.
+/* The assembler module has three implementations for the CRC algorithm. One
+ * is smallest, the others are faster. This CRC routine is only used for
+ * transmitted messages where timing is not critical. The smallest routine
+ * (0) needs 61 to 69 cycles per byte, the faster one (1) needs 31 cycles for
+ * 32 bytes more code, and the table driven one (2, gcc only) needs 18 cycles
+ * but puts a 512 byte table in flash. A faster routine may be worth it if you
+ * transmit lots of data and run the AVR close to its limit.
  */
 
 /* -------------------------- Device Description --------------------------- */
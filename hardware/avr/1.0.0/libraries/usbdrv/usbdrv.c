@@ -9,6 +9,9 @@
 
 #include "usbdrv.h"
 #include "oddebug.h"
+#if USB_CFG_CALIBRATE_OSCILLATOR
+#include "osccal.h"
+#endif
 
 /*
 General Description:
@@ -32,16 +35,28 @@ uchar       usbTxBuf[USB_BUFSIZE];/* data to transmit with next IN, free if usbT
 #if USB_COUNT_SOF
 volatile uchar  usbSofCount;    /* incremented by assembler module every SOF */
 #endif
+#if USB_COUNT_INTERRUPTS
+volatile uchar  usbIntrCount;   /* incremented by assembler module on every exit */
+#endif
 #if USB_CFG_HAVE_INTRIN_ENDPOINT && !USB_CFG_SUPPRESS_INTR_CODE
 usbTxStatus_t  usbTxStatus1;
 #   if USB_CFG_HAVE_INTRIN_ENDPOINT3
 usbTxStatus_t  usbTxStatus3;
 #   endif
+#   if USB_CFG_INTR_QUEUE_SIZE
+static uchar    usbIntrQueue[USB_CFG_INTR_QUEUE_SIZE][USB_CFG_INTR_QUEUE_REPORT_LEN + 1]; /* length, report */
+static uchar    usbIntrQueueHead;   /* index of the next report to send */
+uchar           usbIntrQueueCount;  /* number of reports waiting */
+#   endif
 #endif
 #if USB_CFG_CHECK_DATA_TOGGLING
 uchar       usbCurrentDataToken;/* when we check data toggling to ignore duplicate packets */
 #endif
 
+#if USB_CFG_VERIFY_RX_CRC
+usbRxDiagnostics_t  usbRxDiagnostics;   /* CRC check results, written by usbPoll() only */
+#endif
+
 /* USB status registers / not shared with asm code */
 usbMsgPtr_t         usbMsgPtr;      /* data to transmit next -- ROM or RAM address */
 static usbMsgLen_t  usbMsgLen = USB_NO_MSG; /* remaining number of bytes */
@@ -244,6 +259,57 @@ USB_PUBLIC void usbSetInterrupt(uchar *data, uchar len)
 {
     usbGenericSetInterrupt(data, len, &usbTxStatus1);
 }
+
+#if USB_CFG_INTR_QUEUE_SIZE
+USB_PUBLIC uchar usbQueueInterrupt(uchar *data, uchar len)
+{
+uchar   *entry, i;
+
+    if(usbIntrQueueCount == 0 && usbInterruptIsReady()){
+        usbSetInterrupt(data, len); /* nothing waiting: goes out with the next IN */
+        return 1;
+    }
+    if(usbIntrQueueCount >= USB_CFG_INTR_QUEUE_SIZE)
+        return 0;
+    if(len > USB_CFG_INTR_QUEUE_REPORT_LEN)
+        len = USB_CFG_INTR_QUEUE_REPORT_LEN;
+    i = usbIntrQueueHead + usbIntrQueueCount;
+    if(i >= USB_CFG_INTR_QUEUE_SIZE)
+        i -= USB_CFG_INTR_QUEUE_SIZE;
+    entry = usbIntrQueue[i];
+    *entry++ = len;
+    for(i = 0; i < len; i++)
+        entry[i] = data[i];
+    usbIntrQueueCount++;
+    return 1;
+}
+
+/* Forgets the waiting reports and the one in the transmit buffer: they
+ * belong to a session the host has ended with a bus reset.
+ */
+static inline void usbClearInterruptQueue(void)
+{
+    usbIntrQueueHead = 0;
+    usbIntrQueueCount = 0;
+    usbTxLen1 = USBPID_NAK;
+}
+
+/* Called from usbPoll(): moves the oldest waiting report into the transmit
+ * buffer as soon as the host has taken the previous one.
+ */
+static inline void usbDrainInterruptQueue(void)
+{
+uchar   *entry;
+
+    if(usbIntrQueueCount == 0 || !usbInterruptIsReady())
+        return;
+    entry = usbIntrQueue[usbIntrQueueHead];
+    usbSetInterrupt(entry + 1, entry[0]);
+    if(++usbIntrQueueHead >= USB_CFG_INTR_QUEUE_SIZE)
+        usbIntrQueueHead = 0;
+    usbIntrQueueCount--;
+}
+#endif
 #endif
 
 #if USB_CFG_HAVE_INTRIN_ENDPOINT3
@@ -283,6 +349,9 @@ USB_PUBLIC void usbSetInterrupt3(uchar *data, uchar len)
 #ifndef USB_SET_ADDRESS_HOOK
 #define USB_SET_ADDRESS_HOOK()
 #endif
+#ifndef USB_RX_CRC_ERROR_HOOK
+#define USB_RX_CRC_ERROR_HOOK(data, len)
+#endif
 
 /* ------------------------------------------------------------------------- */
 
@@ -550,12 +619,18 @@ uchar       len;
 
 static inline void usbHandleResetHook(uchar notResetState)
 {
-#ifdef USB_RESET_HOOK
+#if defined(USB_RESET_HOOK) || USB_CFG_CALIBRATE_OSCILLATOR
 static uchar    wasReset;
 uchar           isReset = !notResetState;
 
     if(wasReset != isReset){
+#if USB_CFG_CALIBRATE_OSCILLATOR
+        if(!isReset)    /* must come first: only strobes on the bus yet */
+            calibrateOscillator();
+#endif
+#ifdef USB_RESET_HOOK
         USB_RESET_HOOK(isReset);
+#endif
         wasReset = isReset;
     }
 #else
@@ -565,6 +640,36 @@ uchar           isReset = !notResetState;
 
 /* ------------------------------------------------------------------------- */
 
+#if USB_CFG_VERIFY_RX_CRC
+/* The interrupt routine has ACKed the packet before its CRC was in, so a bad
+ * packet can only be dropped here. On endpoint 0 the control transfer it
+ * belongs to is answered with STALL, which the host reports as an error and
+ * the application may retry. Packets to other endpoints are dropped quietly;
+ * USB_RX_CRC_ERROR_HOOK lets a vendor protocol ask for them again.
+ */
+static inline uchar usbRxCrcIsGood(uchar *data, uchar len)
+{
+unsigned    crc = usbCrc16(data, len);
+
+    usbRxDiagnostics.packets++;
+    if(data[len] == (uchar)crc && data[len + 1] == (uchar)(crc >> 8))
+        return 1;
+    usbRxDiagnostics.crcErrors++;
+    USB_RX_CRC_ERROR_HOOK(data, len);
+#if USB_CFG_IMPLEMENT_FN_WRITEOUT
+    if(usbRxToken < 0x10)   /* OUT to endpoint != 0 */
+        return 0;
+#endif
+    usbRxDiagnostics.controlErrors++;
+    usbMsgLen = USB_NO_MSG;
+    usbMsgFlags = 0;
+    usbTxLen = USBPID_STALL;
+    return 0;
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+
 USB_PUBLIC void usbPoll(void)
 {
 schar   len;
@@ -572,13 +677,16 @@ uchar   i;
 
     len = usbRxLen - 3;
     if(len >= 0){
-/* We could check CRC16 here -- but ACK has already been sent anyway. If you
- * need data integrity checks with this driver, check the CRC in your app
- * code and report errors back to the host. Since the ACK was already sent,
- * retries must be handled on application level.
- * unsigned crc = usbCrc16(buffer + 1, usbRxLen - 3);
+        uchar *data = usbRxBuf + USB_BUFSIZE + 1 - usbInputBufOffset;
+/* The ACK has already been sent when we get here. With USB_CFG_VERIFY_RX_CRC
+ * a packet with a bad CRC is dropped (see usbRxCrcIsGood()), otherwise check
+ * the CRC in your app code and report errors back to the host if you need
+ * data integrity checks: retries must be handled on application level.
  */
-        usbProcessRx(usbRxBuf + USB_BUFSIZE + 1 - usbInputBufOffset, len);
+#if USB_CFG_VERIFY_RX_CRC
+        if(usbRxCrcIsGood(data, len))
+#endif
+        usbProcessRx(data, len);
 #if USB_CFG_HAVE_FLOWCONTROL
         if(usbRxLen > 0)    /* only mark as available if not inactivated */
             usbRxLen = 0;
@@ -591,6 +699,9 @@ uchar   i;
             usbBuildTxBlock();
         }
     }
+#if USB_CFG_INTR_QUEUE_SIZE
+    usbDrainInterruptQueue();
+#endif
     for(i = 20; i > 0; i--){
         uchar usbLineStatus = USBIN & USBMASK;
         if(usbLineStatus != 0)  /* SE0 has ended */
@@ -600,6 +711,9 @@ uchar   i;
     usbNewDeviceAddr = 0;
     usbDeviceAddr = 0;
     usbResetStall();
+#if USB_CFG_INTR_QUEUE_SIZE
+    usbClearInterruptQueue();
+#endif
     DBG1(0xff, 0, 0);
 isNotReset:
     usbHandleResetHook(i);
@@ -609,6 +723,9 @@ isNotReset:
 
 USB_PUBLIC void usbInit(void)
 {
+#if USB_CFG_CALIBRATE_OSCILLATOR
+    restoreOscillatorCalibration();
+#endif
 #if USB_INTR_CFG_SET != 0
     USB_INTR_CFG |= USB_INTR_CFG_SET;
 #endif
@@ -622,6 +739,9 @@ USB_PUBLIC void usbInit(void)
 #if USB_CFG_HAVE_INTRIN_ENDPOINT3
     usbTxLen3 = USBPID_NAK;
 #endif
+#if USB_CFG_INTR_QUEUE_SIZE
+    usbClearInterruptQueue();
+#endif
 #endif
 }
 
@@ -239,6 +239,27 @@ USB_PUBLIC void usbSetInterrupt(uchar *data, uchar len);
  * sent. If you set a new interrupt message before the old was sent, the
  * message already buffered will be lost.
  */
+#if USB_CFG_INTR_QUEUE_SIZE
+USB_PUBLIC uchar usbQueueInterrupt(uchar *data, uchar len);
+/* This function appends a message to a queue of USB_CFG_INTR_QUEUE_SIZE
+ * messages for the interrupt-in endpoint. usbPoll() hands them to
+ * usbSetInterrupt() one at a time, each as soon as the host has taken the
+ * previous one, so a burst of reports can be queued without waiting for
+ * usbInterruptIsReady(). Returns 0 (and drops the message) if the queue is
+ * full. Messages longer than USB_CFG_INTR_QUEUE_REPORT_LEN are truncated.
+ * Don't mix it with direct calls to usbSetInterrupt(), which would overwrite
+ * a message taken from the queue, and don't call it from an interrupt.
+ * usbInit() and a bus reset empty the queue and the transmit buffer, so
+ * messages never reach a host session they were not queued for.
+ */
+extern uchar usbIntrQueueCount;
+#define usbInterruptQueueIsFull()   (usbIntrQueueCount >= USB_CFG_INTR_QUEUE_SIZE)
+#define usbInterruptQueueIsEmpty()  (usbIntrQueueCount == 0)
+/* These macros tell whether usbQueueInterrupt() would fail, and whether all
+ * queued messages have been handed to the transmit buffer. The last one may
+ * still be waiting for the host: check usbInterruptIsReady() for that.
+ */
+#endif
 #if USB_CFG_HAVE_INTRIN_ENDPOINT3
 USB_PUBLIC void usbSetInterrupt3(uchar *data, uchar len);
 #define usbInterruptIsReady3()   (usbTxLen3 & 0x10)
@@ -353,6 +374,29 @@ extern volatile uchar   usbSofCount;
  * the macro USB_COUNT_SOF is defined to a value != 0.
  */
 #endif
+#if USB_COUNT_INTERRUPTS
+extern volatile uchar   usbIntrCount;
+/* This variable is incremented every time the USB interrupt routine returns.
+ * Latency measurements use it to tell the USB interrupt apart from other
+ * interrupts. It is only available if USB_COUNT_INTERRUPTS is != 0.
+ */
+#endif
+#if USB_CFG_VERIFY_RX_CRC
+typedef struct usbRxDiagnostics{
+    unsigned    packets;        /* data packets received */
+    unsigned    crcErrors;      /* of those, dropped for a bad CRC */
+    unsigned    controlErrors;  /* of those, on endpoint 0: answered with STALL */
+}usbRxDiagnostics_t;
+
+extern usbRxDiagnostics_t   usbRxDiagnostics;
+/* Counts the CRC checks made with USB_CFG_VERIFY_RX_CRC, for measuring the
+ * quality of the link. The counters are written by usbPoll() only and wrap
+ * around at 65535; clear them at any time. SETUP, control-out and interrupt
+ * or bulk OUT data packets are counted. Zero sized packets (status stages)
+ * are not: the interrupt routine acknowledges them without passing them to
+ * usbPoll().
+ */
+#endif
 #if USB_CFG_CHECK_DATA_TOGGLING
 extern uchar    usbCurrentDataToken;
 /* This variable can be checked in usbFunctionWrite() and usbFunctionWriteOut()
@@ -571,6 +615,27 @@ int usbDescriptorStringSerialNumber[];
 #ifndef USB_CFG_HAVE_INTRIN_ENDPOINT3
 #define USB_CFG_HAVE_INTRIN_ENDPOINT3   0
 #endif
+#ifndef USB_COUNT_INTERRUPTS
+#define USB_COUNT_INTERRUPTS    0
+#endif
+#ifndef USB_CFG_CALIBRATE_OSCILLATOR
+#define USB_CFG_CALIBRATE_OSCILLATOR    0
+#endif
+#ifndef USB_CFG_VERIFY_RX_CRC
+#define USB_CFG_VERIFY_RX_CRC   0
+#endif
+#if !USB_CFG_HAVE_INTRIN_ENDPOINT || USB_CFG_SUPPRESS_INTR_CODE
+#undef USB_CFG_INTR_QUEUE_SIZE
+#endif
+#ifndef USB_CFG_INTR_QUEUE_SIZE
+#define USB_CFG_INTR_QUEUE_SIZE 0
+#endif
+#ifndef USB_CFG_INTR_QUEUE_REPORT_LEN
+#define USB_CFG_INTR_QUEUE_REPORT_LEN   8
+#endif
+#if USB_CFG_HAVE_INTRIN_ENDPOINT && (USB_CFG_INTR_POLL_INTERVAL < 1 || USB_CFG_INTR_POLL_INTERVAL > 255)
+#error "USB_CFG_INTR_POLL_INTERVAL must be 1 to 255 ms"
+#endif
 
 #define USB_BUFSIZE     11  /* PID, 8 bytes data, 2 bytes CRC */
 
@@ -666,8 +731,16 @@ extern usbTxStatus_t   usbTxStatus1, usbTxStatus3;
 #define usbTxBuf3   usbTxStatus3.buffer
 
 
+#ifndef usbWordValue_t
+#define usbWordValue_t  unsigned
+#endif
+/* usbWordValue_t is the 16 bit integer type in usbWord_t. It needs to be
+ * redefined only when the driver is compiled for a machine where unsigned
+ * is wider than 16 bits, such as the host harness in extras/host.
+ */
+
 typedef union usbWord{
-    unsigned    word;
+    usbWordValue_t  word;
     uchar       bytes[2];
 }usbWord_t;
 
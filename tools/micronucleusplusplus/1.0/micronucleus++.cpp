@@ -5,6 +5,7 @@
 
 #include <micronucleus_util.h>
 #include <delay_util.h>
+#include <upload_log_util.h>
 
 using namespace std;
 
@@ -14,7 +15,10 @@ enum filetype_t {INTEL_HEX, RAW};
 
 
 static const char * const usage = "usage: micronucleus [--help] [--run] [--dump-progress] [--fast-mode] "
-    "[--type intel-hex|raw] [--timeout integer] [--erase-only] filename";
+    "[--type intel-hex|raw] [--timeout integer] [--erase-only] [--app-id vid:pid|none] "
+    "[--log filename|none] filename\n"
+    "       micronucleus --list [--app-id vid:pid]\n"
+    "       micronucleus --stats [--log filename]";
 
 static const char * const prefix[] = {"micronucleus: ", "              "};
 
@@ -45,13 +49,39 @@ static void printProgress(float f) {
 }
 
 
+// every upload that reached the device is logged, however it ends
+static UploadLog *uploadLog = NULL;
+static UploadRecord uploadRecord;
+
+static void logUpload() {
+  if (uploadLog && !uploadLog->append(uploadRecord)) {
+    cerr << prefix[0] << "Could not write to the upload log." << endl;
+  }
+}
+
+static void printDevice(const Micronucleus &device, bool bootloader) {
+  if (bootloader) {
+    cout << prefix[0] << device.path << ": bootloader version " << (int)device.version.major << "." << (int)device.version.minor << endl
+         << prefix[1] << "Device signature  : 0x1E" << hex << uppercase << setfill('0') << setw(4) << device.signature << dec << nouppercase << setfill(' ') << setw(0) << endl
+         << prefix[1] << "Available space   : " << device.flashSize << " bytes" << endl
+         << prefix[1] << "Page size         : " << device.pageSize << endl
+         << prefix[1] << "Write sleep time  : " << device.writeSleep << "ms" << endl
+         << prefix[1] << "Erase sleep time  : " << device.eraseSleep << "ms" << endl;
+  } else {
+    cout << prefix[0] << device.path << ": application version " << (int)device.version.major << "." << (int)device.version.minor << endl;
+  }
+}
+
+
 int main(int argc, char **argv) {
   struct {
     const char *filename;
     filetype_t filetype;
-    bool run, dumpProgress, eraseOnly, fastMode;
+    bool run, dumpProgress, eraseOnly, fastMode, appReset, list, stats;
     int timeout;
-  } options = {NULL, INTEL_HEX, false, false, false, false, 0};
+    unsigned int appVendorId, appProductId;
+    const char *logFilename;
+  } options = {NULL, INTEL_HEX, false, false, false, false, true, false, false, 0, MICRONUCLEUS_APP_VENDOR_ID, MICRONUCLEUS_APP_PRODUCT_ID, NULL};
   
   unsigned char dataBuffer[65536 + 256];
 
@@ -79,6 +109,15 @@ int main(int argc, char **argv) {
            << "                    --run: Ask bootloader to run the program when finished"    << endl
            << "                           uploading provided program."                        << endl
            << "      --timeout [integer]: Timeout after waiting specified number of seconds." << endl
+           << "  --app-id [vid:pid|none]: Ask a running sketch with this USB ID to start"     << endl
+           << "                           the bootloader (default 16c0:27db). \"none\""       << endl
+           << "                           waits for a manual reset instead."                  << endl
+           << "                   --list: List the bootloaders and running sketches on"      << endl
+           << "                           all buses."                                         << endl
+           << "   --log [filename, none]: Append a line per upload to this file (default"    << endl
+           << "                           ~/.micronucleus++-log)."                            << endl
+           << "                  --stats: Print throughput, upload time percentiles and"     << endl
+           << "                           failure rates per port from the upload log."        << endl
            << "                 filename: Path to intel hex or raw data file to upload,"      << endl
            << "                           or \"-\" to read from stdin."                       << endl
            << endl
@@ -106,6 +145,27 @@ int main(int argc, char **argv) {
         cout << prefix[0] << "Did not understand timeout value \"" << argv[i] << "\".";
         exit(EXIT_FAILURE);
       }
+    } else if (strcmp(argv[i], "--app-id") == 0) {
+      if (++i == argc) {
+        cout << usage << endl;
+        exit(EXIT_FAILURE);
+      }
+      if (strcmp(argv[i], "none") == 0) {
+        options.appReset = false;
+      } else if (sscanf(argv[i], "%x:%x", &options.appVendorId, &options.appProductId) != 2) {
+        cout << prefix[0] << "Did not understand application ID \"" << argv[i] << "\".";
+        exit(EXIT_FAILURE);
+      }
+    } else if (strcmp(argv[i], "--list") == 0) {
+      options.list = true;
+    } else if (strcmp(argv[i], "--log") == 0) {
+      if (++i == argc) {
+        cout << usage << endl;
+        exit(EXIT_FAILURE);
+      }
+      options.logFilename = argv[i];
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      options.stats = true;
     } else if (strcmp(argv[i], "--erase-only") == 0) {
       options.eraseOnly = true;
       totalSteps -= 1;
@@ -114,18 +174,43 @@ int main(int argc, char **argv) {
     }
   }
 
+  string logFilename = options.logFilename ? options.logFilename : UploadLog::defaultFilename();
+
+  if (options.stats) {
+    reportUploadStats(UploadLog(logFilename).read(), cout);
+    exit(EXIT_SUCCESS);
+  }
+
   cout << prefix[0] << "Commandline tool version " << MICRONUCLEUS_COMMANDLINE_VERSION << endl
-       << endl
-       << prefix[0] << "Please connect or reset the device now." << endl
-       << prefix[0] << "Searching for device... ";
+       << endl;
+
+  Micronucleus micronucleus;
+  micronucleus.callbackFn = printProgress;
+
+  if (options.list) {
+    if (micronucleus.list(options.appVendorId, options.appProductId, options.fastMode, printDevice) == 0) {
+      cout << prefix[0] << "No devices found." << endl;
+    }
+
+    exit(EXIT_SUCCESS);
+  }
+
+  // a sketch using TinyBootloader restarts into the bootloader on request
+  if (options.appReset && micronucleus.resetApplication(options.appVendorId, options.appProductId) > 0) {
+    cout << prefix[0] << "Asked the running sketch to start the bootloader." << endl;
+  } else {
+    cout << prefix[0] << "Please connect or reset the device now." << endl;
+  }
+
+  cout << prefix[0] << "Searching for device... ";
 
   time_t startTime, currentTime;
   time(&startTime);
 
-  Micronucleus micronucleus;
-  micronucleus.callbackFn = printProgress;
+  unsigned long phaseStart;
 
   do {
+    phaseStart = millis();
     micronucleus.connect(options.fastMode);
     time(&currentTime);
   } while (!micronucleus.connected && (options.timeout == 0 || currentTime < startTime + options.timeout));
@@ -143,6 +228,18 @@ int main(int argc, char **argv) {
     cout << "OK!" << endl;
   }
 
+  uploadRecord.time = currentTime;
+  uploadRecord.path = micronucleus.path;
+  uploadRecord.signature = micronucleus.signature;
+  uploadRecord.major = micronucleus.version.major;
+  uploadRecord.minor = micronucleus.version.minor;
+  uploadRecord.connectMs = millis() - phaseStart;
+
+  if (logFilename != "none") {
+    uploadLog = new UploadLog(logFilename);
+    atexit(logUpload);
+  }
+
   cout << endl
        << prefix[0] << "Device firmware   : Version " << (int)micronucleus.version.major << "." << (int)micronucleus.version.minor << endl
        << prefix[1] << "Device signature  : 0x1E" << hex << uppercase << setfill('0') << setw(4) << micronucleus.signature << dec << nouppercase << setfill(' ') << setw(0) << endl
@@ -240,8 +337,12 @@ int main(int argc, char **argv) {
     }
   }
 
+  if (!options.eraseOnly) uploadRecord.imageHash = hashImage(dataBuffer + startAddress, endAddress - startAddress);
+
   cout << endl << "Erasing | ";
+  phaseStart = millis();
   res = micronucleus.erase();
+  uploadRecord.eraseError = res;
   cout << " | 100%" << endl << endl;
 
   switch (res) {
@@ -275,12 +376,14 @@ int main(int argc, char **argv) {
           }
         } while (!micronucleus.connected);
 
+        uploadRecord.retries++;
         cout << "OK!" << endl << endl;
       }
       break;
     }
     
     default: {
+      uploadRecord.eraseMs = millis() - phaseStart;
       cout << prefix[0] << "Flash error " << res << " has occurred." << endl
            << prefix[0] << "Please unplug the device and try again." << endl << problemString;
 
@@ -289,9 +392,14 @@ int main(int argc, char **argv) {
     }
   }
 
+  uploadRecord.eraseMs = millis() - phaseStart;
+
   if (!options.eraseOnly) {
     cout << "Writing | ";
+    phaseStart = millis();
     res = micronucleus.write(dataBuffer, endAddress);
+    uploadRecord.writeError = res;
+    uploadRecord.writeMs = millis() - phaseStart;
     cout << " | 100%" << endl << endl;
 
     if (res != 0) {
@@ -305,7 +413,10 @@ int main(int argc, char **argv) {
   if (options.run) {
     cout << prefix[0] << "Starting the user app... ";
 
+    phaseStart = millis();
     res = micronucleus.run();
+    uploadRecord.runError = res;
+    uploadRecord.runMs = millis() - phaseStart;
 
     if (res != 0) {
       cout << prefix[0] << "Run error " << res << " has occurred." << endl
@@ -319,5 +430,6 @@ int main(int argc, char **argv) {
 
   cout << endl << endl << finishedString << endl;
 
+  uploadRecord.ok = true;
   exit(EXIT_SUCCESS);
 }
\ No newline at end of file
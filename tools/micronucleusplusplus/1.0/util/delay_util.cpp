@@ -10,3 +10,14 @@ void delay(unsigned long duration) {
     usleep(duration*1000);
   #endif
 }
+
+/* Milliseconds from an arbitrary starting point, for timing */
+unsigned long millis() {
+  #if defined _WIN32 || defined _WIN64
+    return GetTickCount();
+  #else
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 1000UL + now.tv_usec / 1000;
+  #endif
+}
@@ -5,9 +5,13 @@
   #include <windows.h>
 #else
   #include <unistd.h>
+  #include <sys/time.h>
 #endif
 
 /* Delay in miliseconds */
 void delay(unsigned long duration);
 
+/* Milliseconds from an arbitrary starting point, for timing */
+unsigned long millis();
+
 #endif
@@ -1,7 +1,13 @@
 #include <micronucleus_util.h>
 #include <delay_util.h>
 #include <cassert>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#if defined __linux__
+  #include <dirent.h>
+#endif
 // #include <stdio.h>
 // #include <stdlib.h>
 
@@ -13,6 +19,70 @@ Micronucleus::Micronucleus() {
   connected = false;
 }
 
+static bool isBootloader(struct usb_device *dev) {
+  return dev->descriptor.idVendor == MICRONUCLEUS_VENDOR_ID && dev->descriptor.idProduct == MICRONUCLEUS_PRODUCT_ID;
+}
+
+#if defined __linux__
+static int readSysfsNumber(const string &filename) {
+  int number = -1;
+  ifstream(filename.c_str()) >> number;
+  return number;
+}
+#endif
+
+/* The port a device is plugged into, which unlike the device number stays the
+ * same when it re-enumerates. libusb 0.1 doesn't know about ports, so on linux
+ * the path is looked up in sysfs. Elsewhere the libusb device name is used.
+ */
+static string portPath(struct usb_bus *bus, struct usb_device *dev) {
+  #if defined __linux__
+    if (DIR *dir = opendir("/sys/bus/usb/devices")) {
+      int busnum = atoi(bus->dirname);
+
+      for (struct dirent *entry; (entry = readdir(dir));) {
+        string name = entry->d_name, base = string("/sys/bus/usb/devices/") + name + "/";
+
+        if (name[0] == '.' || name.find(':') != string::npos) continue; // interfaces
+
+        if (readSysfsNumber(base + "busnum") == busnum && readSysfsNumber(base + "devnum") == dev->devnum) {
+          closedir(dir);
+          return name;
+        }
+      }
+
+      closedir(dir);
+    }
+  #endif
+
+  return string(bus->dirname) + "/" + dev->filename;
+}
+
+/* Opens a running sketch with the given VID/PID if its manufacturer and
+ * product strings name one of the libraries that handle the bootloader
+ * request. Returns NULL for any other device, which may share the IDs.
+ */
+static usb_dev_handle *openApplication(struct usb_device *dev, unsigned int vendorId, unsigned int productId) {
+  static const char * const products[] = MICRONUCLEUS_APP_PRODUCTS;
+  char manufacturer[64], product[64];
+
+  if (dev->descriptor.idVendor != vendorId || dev->descriptor.idProduct != productId) return NULL;
+
+  usb_dev_handle *app = usb_open(dev);
+  if (app == NULL) return NULL;
+
+  if (usb_get_string_simple(app, dev->descriptor.iManufacturer, manufacturer, sizeof(manufacturer)) > 0 &&
+      usb_get_string_simple(app, dev->descriptor.iProduct, product, sizeof(product)) > 0 &&
+      strcmp(manufacturer, MICRONUCLEUS_APP_MANUFACTURER) == 0) {
+    for (size_t i = 0; i < sizeof(products) / sizeof(products[0]); i++) {
+      if (strcmp(product, products[i]) == 0) return app;
+    }
+  }
+
+  usb_close(app);
+  return NULL;
+}
+
 int Micronucleus::connect(bool fastMode) {
   connected = false;
 
@@ -22,90 +92,174 @@ int Micronucleus::connect(bool fastMode) {
 
   for (struct usb_bus *bus = usb_get_busses(); bus; bus = bus->next) {
     for (struct usb_device *dev = bus->devices; dev; dev = dev->next) {
-      if (dev->descriptor.idVendor == MICRONUCLEUS_VENDOR_ID && dev->descriptor.idProduct == MICRONUCLEUS_PRODUCT_ID) {
+      if (isBootloader(dev)) {
+        int res = open(bus, dev, fastMode);
+        if (res != 0) return res;
+
+        connected = true;
+        return 0;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/* Calls printFn for every bootloader and every running sketch with the given
+ * VID/PID on all buses. Returns the number of devices found.
+ */
+int Micronucleus::list(unsigned int vendorId, unsigned int productId, bool fastMode, void (*printFn)(const Micronucleus &, bool)) {
+  int found = 0;
+
+  usb_init();
+  usb_find_busses();
+  usb_find_devices();
+
+  for (struct usb_bus *bus = usb_get_busses(); bus; bus = bus->next) {
+    for (struct usb_device *dev = bus->devices; dev; dev = dev->next) {
+      if (isBootloader(dev)) {
+        if (open(bus, dev, fastMode) != 0) continue;
+
+        printFn(*this, true);
+        usb_close(device);
+        device = NULL;
+        found++;
+      } else if (usb_dev_handle *app = openApplication(dev, vendorId, productId)) {
+        usb_close(app);
         version.major = (dev->descriptor.bcdDevice >> 8) & 0xFF;
         version.minor = (dev->descriptor.bcdDevice >> 0) & 0xFF;
+        path = portPath(bus, dev);
 
-        device = usb_open(dev);
-
-        switch (version.major) {
-          case 1: {
-            unsigned char buffer[4];
-            int res = usb_control_msg(device, USB_ENDPOINT_IN | USB_TYPE_VENDOR | USB_RECIP_DEVICE, 0, 0, 0, (char *)buffer, 4, MICRONUCLEUS_USB_TIMEOUT);
-            
-            // Device descriptor was found, but talking to it was not successful. This can happen when the device is being reset.
-            if (res < 0) {
-              device = NULL;
-              return 2;
-            }
-              
-            assert(res >= 4);
-
-            flashSize = (buffer[0] << 8) | buffer[1];
-            pageSize = buffer[2];
-            pages = flashSize / pageSize;
-            if (pages * pageSize < flashSize) pages += 1;
-            
-            bootloaderStart = pages * pageSize;
-            
-            writeSleep = buffer[3] & 0x7F;
-            eraseSleep = writeSleep * pages;       
-            
-            signature = 0;
-
-            break;
-          }
-          
-          case 2: {
-            unsigned char buffer[6];
-            int res = usb_control_msg(device, USB_ENDPOINT_IN | USB_TYPE_VENDOR | USB_RECIP_DEVICE, 0, 0, 0, (char *)buffer, 6, MICRONUCLEUS_USB_TIMEOUT);
-
-            // Device descriptor was found, but talking to it was not successful. This can happen when the device is being reset.
-            if (res < 0) {
-              device = NULL;
-              return 2;
-            }
+        printFn(*this, false);
+        found++;
+      }
+    }
+  }
+
+  return found;
+}
 
-            assert(res >= 6);
+// Opens a bootloader and reads its device info (request 0).
+int Micronucleus::open(struct usb_bus *bus, struct usb_device *dev, bool fastMode) {
+  version.major = (dev->descriptor.bcdDevice >> 8) & 0xFF;
+  version.minor = (dev->descriptor.bcdDevice >> 0) & 0xFF;
+  path = portPath(bus, dev);
+  this->fastMode = fastMode;
 
-            flashSize = (buffer[0] << 8) | buffer[1];
-            pageSize = buffer[2];
-            pages = flashSize / pageSize;
-            if (pages * pageSize < flashSize) pages += 1;
+  if (version.major < 1 || version.major > MICRONUCLEUS_MAX_MAJOR_VERSION) {
+    cerr << "Warning: device with unknown version of Micronucleus detected." << endl
+         << "This tool doesn't know how to upload to the device. Updates may be available." << endl
+         << "Device reports version as: " << (int)version.major << "." << (int)version.minor << endl;
 
-            bootloaderStart = pages * pageSize;
+    return 1;
+  }
 
-            // firmware v2 reports more aggressive write times. Add 2ms if fast mode is not used.
-            writeSleep = (buffer[3] & 0x7F) + (fastMode ? 0 : 2);
+  device = usb_open(dev);
 
-            // if bit 7 of write sleep time is set, divide the erase time by four to accomodate to the 4*page erase of the ATtiny841/441
-            eraseSleep = (writeSleep * pages) / (buffer[3] & 0x80 ? 4 : 1);
+  // Device descriptor was found, but talking to it was not successful. This can happen when the device is being reset.
+  if (readInfo(info) < 0) {
+    usb_close(device);
+    device = NULL;
+    return 2;
+  }
 
-            signature = (buffer[4] << 8) | buffer[5];
+  parseInfo();
 
-            break;
-          }
-          
-          default: {
-            usb_close(device);
-            device = NULL;
+  return 0;
+}
 
-            cerr << "Warning: device with unknown version of Micronucleus detected." << endl
-                 << "This tool doesn't know how to upload to the device. Updates may be available." << endl
-                 << "Device reports version as: " << (int)version.major << "." << (int)version.minor << endl;
+int Micronucleus::infoLength() const {
+  return version.major == 1 ? 4 : 6;
+}
 
-            return 1;
-          }
-        }
+int Micronucleus::readInfo(unsigned char *buffer) {
+  int res = usb_control_msg(device, USB_ENDPOINT_IN | USB_TYPE_VENDOR | USB_RECIP_DEVICE, 0, 0, 0, (char *)buffer, infoLength(), MICRONUCLEUS_USB_TIMEOUT);
+  if (res < 0) return res;
 
-        connected = true;
-        goto break_outer;
+  assert(res >= infoLength());
+  return 0;
+}
+
+void Micronucleus::parseInfo() {
+  const unsigned char *buffer = info;
+
+  switch (version.major) {
+    case 1: {
+      flashSize = (buffer[0] << 8) | buffer[1];
+      pageSize = buffer[2];
+      pages = flashSize / pageSize;
+      if (pages * pageSize < flashSize) pages += 1;
+
+      bootloaderStart = pages * pageSize;
+
+      writeSleep = buffer[3] & 0x7F;
+      eraseSleep = writeSleep * pages;
+
+      signature = 0;
+
+      break;
+    }
+
+    case 2: {
+      flashSize = (buffer[0] << 8) | buffer[1];
+      pageSize = buffer[2];
+      pages = flashSize / pageSize;
+      if (pages * pageSize < flashSize) pages += 1;
+
+      bootloaderStart = pages * pageSize;
+
+      // firmware v2 reports more aggressive write times. Add 2ms if fast mode is not used.
+      writeSleep = (buffer[3] & 0x7F) + (fastMode ? 0 : 2);
+
+      // if bit 7 of write sleep time is set, divide the erase time by four to accomodate to the 4*page erase of the ATtiny841/441
+      eraseSleep = (writeSleep * pages) / (buffer[3] & 0x80 ? 4 : 1);
+
+      signature = (buffer[4] << 8) | buffer[5];
+
+      break;
+    }
+  }
+}
+
+/* Asks the running sketch with the given VID/PID to restart into the
+ * bootloader. Nothing is sent if several sketches are attached, since the
+ * uploader can't tell which one the user means. Returns 1 if the request was
+ * sent, 0 if it wasn't and a negative libusb error otherwise.
+ */
+int Micronucleus::resetApplication(unsigned int vendorId, unsigned int productId) {
+  usb_dev_handle *app = NULL;
+  string paths;
+  int found = 0;
+
+  usb_init();
+  usb_find_busses();
+  usb_find_devices();
+
+  for (struct usb_bus *bus = usb_get_busses(); bus; bus = bus->next) {
+    for (struct usb_device *dev = bus->devices; dev; dev = dev->next) {
+      if (usb_dev_handle *handle = openApplication(dev, vendorId, productId)) {
+        paths += (found++ ? ", " : "") + portPath(bus, dev);
+
+        if (app) usb_close(handle);
+        else app = handle;
       }
     }
   }
-  break_outer:
 
-  return 0;
+  if (app == NULL) return 0;
+
+  if (found > 1) {
+    cerr << "Warning: found running sketches on " << paths << "." << endl
+         << "Not knowing which one to upload to, none of them is restarted." << endl;
+
+    usb_close(app);
+    return 0;
+  }
+
+  int res = usb_control_msg(app, USB_ENDPOINT_OUT | USB_TYPE_VENDOR | USB_RECIP_DEVICE, MICRONUCLEUS_APP_REQUEST_BOOTLOADER, 0, 0, NULL, 0, MICRONUCLEUS_USB_TIMEOUT);
+  usb_close(app);
+
+  return res < 0 ? res : 1;
 }
 
 int Micronucleus::erase() {
@@ -153,6 +307,11 @@ int Micronucleus::erase() {
 }
 
 int Micronucleus::write(unsigned char *program, unsigned int programSize) {
+  if (programSize > flashSize) {
+    cerr << "The program (" << programSize << " bytes) does not fit in the " << flashSize << " bytes of the device." << endl;
+    return -1;
+  }
+
   for (unsigned int address = 0; address < flashSize; address += pageSize) {
     unsigned char pageLength = pageSize;
     unsigned char pageBuffer[pageLength];
@@ -7,11 +7,21 @@
   #include <usb.h>        // this is libusb, see http://libusb.sourceforge.net/
 #endif
 
+#include <string>
+
 #define MICRONUCLEUS_VENDOR_ID   0x16D0
 #define MICRONUCLEUS_PRODUCT_ID  0x0753
 #define MICRONUCLEUS_USB_TIMEOUT 0xFFFF
 #define MICRONUCLEUS_MAX_MAJOR_VERSION 2
 
+// running sketch that can restart into the bootloader (libraries/TinyBootloader)
+#define MICRONUCLEUS_APP_VENDOR_ID  0x16C0
+#define MICRONUCLEUS_APP_PRODUCT_ID 0x27DB
+#define MICRONUCLEUS_APP_REQUEST_BOOTLOADER 0xB0
+// the IDs are shared with other V-USB devices; these strings tell ours apart
+#define MICRONUCLEUS_APP_MANUFACTURER "mjbcopland@gmail.com"
+#define MICRONUCLEUS_APP_PRODUCTS {"TinyKeyboard", "TinyRawHID", "TinyUSBStream"}
+
 #define MICRONUCLEUS_COMMANDLINE_VERSION "3.0"
 
 struct MicronucleusVersion {
@@ -22,6 +32,7 @@ class Micronucleus {
 public:
   bool connected;
   usb_dev_handle *device;
+  std::string path;             // USB port path, e.g. 1-1.2 on linux
   MicronucleusVersion version;
   unsigned int flashSize;       // programmable size (in bytes) of progmem
   unsigned int pageSize;        // size (in bytes) of page
@@ -34,9 +45,20 @@ public:
 
   Micronucleus();
   int connect(bool);
+  int list(unsigned int, unsigned int, bool, void (*)(const Micronucleus &, bool));
+  int resetApplication(unsigned int, unsigned int);
   int erase();
   int write(unsigned char *, unsigned int);
   int run();
+
+private:
+  bool fastMode;
+  unsigned char info[6];        // device info reply (request 0)
+
+  int open(struct usb_bus *, struct usb_device *, bool);
+  int infoLength() const;
+  int readInfo(unsigned char *);
+  void parseInfo();
 };
 
 #endif
\ No newline at end of file
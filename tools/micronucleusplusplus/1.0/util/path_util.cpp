@@ -0,0 +1,13 @@
+#include <path_util.h>
+#include <cstdlib>
+
+/* Path of a file in the user's home directory (%APPDATA% on windows) */
+std::string userFilename(const char *name) {
+  #if defined _WIN32 || defined _WIN64
+    const char *home = getenv("APPDATA");
+  #else
+    const char *home = getenv("HOME");
+  #endif
+
+  return std::string(home ? home : ".") + "/" + name;
+}
@@ -0,0 +1,9 @@
+#ifndef PATH_UTIL_H
+#define PATH_UTIL_H
+
+#include <string>
+
+/* Path of a file in the user's home directory (%APPDATA% on windows) */
+std::string userFilename(const char *name);
+
+#endif
@@ -0,0 +1,206 @@
+#include <upload_log_util.h>
+#include <path_util.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+using namespace std;
+
+static const char * const header =
+  "# time\tpath\tsignature\tversion\timage\tconnect_ms\terase_ms\twrite_ms\trun_ms\tretries\terase_error\twrite_error\trun_error\tresult";
+
+UploadRecord::UploadRecord() {
+  time = 0;
+  signature = major = minor = 0;
+  path = imageHash = "-";
+  connectMs = eraseMs = writeMs = runMs = 0;
+  retries = 0;
+  eraseError = writeError = runError = UPLOAD_NOT_RUN;
+  ok = false;
+}
+
+UploadLog::UploadLog(const string &filename) : filename(filename) {}
+
+static string formatError(int error) {
+  if (error == UPLOAD_NOT_RUN) return "-";
+
+  ostringstream text;
+  text << error;
+  return text.str();
+}
+
+static int parseError(const string &text) {
+  return text == "-" ? UPLOAD_NOT_RUN : atoi(text.c_str());
+}
+
+bool UploadLog::append(const UploadRecord &record) {
+  bool empty;
+  {
+    ifstream input(filename.c_str());
+    empty = input.peek() == ifstream::traits_type::eof();
+  }
+
+  ostringstream line;
+  if (empty) line << header << '\n';
+
+  line << record.time << '\t'
+       << record.path << '\t'
+       << hex << setfill('0') << setw(4) << record.signature << dec << setfill(' ') << '\t'
+       << record.major << '.' << record.minor << '\t'
+       << record.imageHash << '\t'
+       << record.connectMs << '\t' << record.eraseMs << '\t' << record.writeMs << '\t' << record.runMs << '\t'
+       << record.retries << '\t'
+       << formatError(record.eraseError) << '\t' << formatError(record.writeError) << '\t' << formatError(record.runError) << '\t'
+       << (record.ok ? "ok" : "failed") << '\n';
+
+  // a single write keeps lines from concurrent stations apart
+  FILE *output = fopen(filename.c_str(), "a");
+  if (!output) return false;
+
+  string text = line.str();
+  bool written = fwrite(text.data(), 1, text.size(), output) == text.size();
+  return fclose(output) == 0 && written;
+}
+
+vector<UploadRecord> UploadLog::read() const {
+  vector<UploadRecord> records;
+  ifstream input(filename.c_str());
+
+  for (string line; getline(input, line);) {
+    if (line.empty() || line[0] == '#') continue;
+
+    istringstream fields(line);
+    UploadRecord record;
+    string signature, version, eraseError, writeError, runError, result;
+
+    fields >> record.time >> record.path >> signature >> version >> record.imageHash
+           >> record.connectMs >> record.eraseMs >> record.writeMs >> record.runMs >> record.retries
+           >> eraseError >> writeError >> runError >> result;
+
+    if (!fields) continue; // truncated by a crash
+
+    record.signature = strtoul(signature.c_str(), NULL, 16);
+    sscanf(version.c_str(), "%u.%u", &record.major, &record.minor);
+    record.eraseError = parseError(eraseError);
+    record.writeError = parseError(writeError);
+    record.runError = parseError(runError);
+    record.ok = result == "ok";
+
+    records.push_back(record);
+  }
+
+  return records;
+}
+
+string UploadLog::defaultFilename() {
+  return userFilename(".micronucleus++-log");
+}
+
+string hashImage(const unsigned char *data, unsigned int length) {
+  unsigned long hash = 2166136261UL; // 32 bit FNV-1a
+
+  for (unsigned int i = 0; i < length; i++) {
+    hash = ((hash ^ data[i]) * 16777619UL) & 0xFFFFFFFFUL;
+  }
+
+  ostringstream text;
+  text << hex << setfill('0') << setw(8) << hash;
+  return text.str();
+}
+
+// nearest rank percentile of sorted values
+static unsigned long percentile(const vector<unsigned long> &sorted, unsigned int p) {
+  if (sorted.empty()) return 0;
+
+  size_t rank = (sorted.size() * p + 99) / 100;
+  return sorted[rank ? rank - 1 : 0];
+}
+
+struct PortStats {
+  unsigned int uploads, failed, retries;
+  vector<unsigned long> durations; // successful uploads only
+
+  PortStats() : uploads(0), failed(0), retries(0) {}
+};
+
+static void addUpload(PortStats &stats, const UploadRecord &record) {
+  stats.uploads++;
+  stats.retries += record.retries;
+
+  if (record.ok) {
+    stats.durations.push_back(record.totalMs());
+  } else {
+    stats.failed++;
+  }
+}
+
+void reportUploadStats(const vector<UploadRecord> &records, ostream &output) {
+  if (records.empty()) {
+    output << "No uploads logged." << endl;
+    return;
+  }
+
+  PortStats total;
+  map<string, PortStats> ports;
+  map<int, unsigned int> errors; // first failing error code -> count
+  time_t first = records.front().time, last = records.front().time;
+
+  for (size_t i = 0; i < records.size(); i++) {
+    const UploadRecord &record = records[i];
+
+    addUpload(total, record);
+    addUpload(ports[record.path], record);
+
+    first = min(first, record.time);
+    last = max(last, record.time);
+
+    if (!record.ok) {
+      int error = record.eraseError != 0 && record.eraseError != UPLOAD_NOT_RUN ? record.eraseError
+                : record.writeError != 0 && record.writeError != UPLOAD_NOT_RUN ? record.writeError
+                : record.runError;
+      errors[error]++;
+    }
+  }
+
+  sort(total.durations.begin(), total.durations.end());
+
+  output << fixed << setprecision(1)
+         << "Uploads           : " << total.uploads << ", " << total.failed << " failed ("
+         << 100.0 * total.failed / total.uploads << "%), " << total.retries << " reconnects" << endl;
+
+  if (last > first) {
+    output << "Throughput        : " << (total.uploads - total.failed) * 3600.0 / (last - first) << " units/hour over "
+           << (last - first) / 3600.0 << " hours" << endl;
+  }
+
+  output << "Upload time       : p50 " << percentile(total.durations, 50) << "ms, p90 "
+         << percentile(total.durations, 90) << "ms, p99 " << percentile(total.durations, 99) << "ms" << endl;
+
+  if (!errors.empty()) {
+    output << "Errors            :";
+    for (map<int, unsigned int>::const_iterator i = errors.begin(); i != errors.end(); ++i) {
+      output << ' ' << formatError(i->first) << " (" << i->second << "x)";
+    }
+    output << endl;
+  }
+
+  output << endl
+         << left << setw(20) << "Port" << right
+         << setw(9) << "Uploads" << setw(8) << "Failed" << setw(8) << "Rate"
+         << setw(12) << "Reconnects" << setw(10) << "p50 ms" << setw(10) << "p90 ms" << endl;
+
+  for (map<string, PortStats>::iterator i = ports.begin(); i != ports.end(); ++i) {
+    PortStats &port = i->second;
+    sort(port.durations.begin(), port.durations.end());
+
+    output << left << setw(20) << i->first << right
+           << setw(9) << port.uploads << setw(8) << port.failed
+           << setw(7) << 100.0 * port.failed / port.uploads << '%'
+           << setw(12) << port.retries
+           << setw(10) << percentile(port.durations, 50) << setw(10) << percentile(port.durations, 90) << endl;
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef UPLOAD_LOG_UTIL_H
+#define UPLOAD_LOG_UTIL_H
+
+#include <ctime>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#define UPLOAD_NOT_RUN -1000 // error code of a phase that was skipped
+
+/* One run of micronucleus++ against a device */
+struct UploadRecord {
+  time_t time;
+  std::string path;          // USB port path
+  unsigned int signature;
+  unsigned int major, minor; // firmware version
+  std::string imageHash;     // FNV-1a of the uploaded image, "-" for erase only
+  unsigned long connectMs, eraseMs, writeMs, runMs;
+  int retries;               // reconnects after erasing
+  int eraseError, writeError, runError;
+  bool ok;
+
+  UploadRecord();
+  unsigned long totalMs() const { return connectMs + eraseMs + writeMs + runMs; }
+};
+
+/* Append-only log of uploads, one tab separated line per upload. Lines
+ * starting with # are comments. Old lines are never rewritten, so several
+ * stations may share a file on a network drive.
+ */
+class UploadLog {
+public:
+  UploadLog(const std::string &filename);
+
+  bool append(const UploadRecord &record);
+  std::vector<UploadRecord> read() const;
+
+  static std::string defaultFilename();
+
+private:
+  std::string filename;
+};
+
+std::string hashImage(const unsigned char *data, unsigned int length);
+
+/* Throughput, latency percentiles and failure rates per port */
+void reportUploadStats(const std::vector<UploadRecord> &records, std::ostream &output);
+
+#endif